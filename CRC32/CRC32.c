@@ -0,0 +1,457 @@
+
+#include <stdint.h>
+#include "CRC32.h"
+#include "CRC32_TABLES.h"
+
+
+// crc32_table[0] is the classic 256 entry table of crc32c in CRC32_BIBLE.c.
+// crc32_table[k][n] is the CRC of byte n followed by k zero bytes, which lets
+// the slicing loops look up 8 or 16 message bytes independently and XOR them.
+#define crc32_table crc32_table_ieee
+
+static uint32_t crc32_resolve_update(uint32_t crc, const void *data, size_t len);
+
+// Starts on the resolver, which selects CRC32_DEFAULT_ENGINE on the first call
+static crc32_update_fn crc32_engine_fn = crc32_resolve_update;
+static int crc32_engine = -1;
+
+static const char *crc32_engine_names[CRC32_ENGINE_COUNT] = {
+    "bitwise",
+    "slice8",
+    "slice16",
+    "pclmul",
+    "vpclmul",
+    "table",
+    "halfword"
+};
+
+// crc32d table, 64K entries: table[h] is h shifted through the register 16 times.
+// Too big to ship as constant data, it is built by crc32_select_engine() when the
+// halfword engine is chosen, before any thread uses it.
+static uint32_t crc32_halfword_table[65536];
+
+
+// Function to read 32-bit values (little endian) from a possibly unaligned pointer
+static inline uint32_t crc32_load32(const uint8_t *p) {
+    uint32_t word;
+    memcpy(&word, p, sizeof(word));
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+    word = __builtin_bswap32(word);
+#endif
+    return word;
+}
+
+
+// Function to read 32-bit values (big endian), for the models that are not reflected
+static inline uint32_t crc32_load32_be(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+
+// Reverses (reflects) bits in a 32-bit word, like reverse() in CRC32_BIBLE.c
+static uint32_t crc32_reflect(uint32_t x) {
+    x = ((x & 0x55555555) <<  1) | ((x >>  1) & 0x55555555);
+    x = ((x & 0x33333333) <<  2) | ((x >>  2) & 0x33333333);
+    x = ((x & 0x0F0F0F0F) <<  4) | ((x >>  4) & 0x0F0F0F0F);
+    x = (x << 24) | ((x & 0xFF00) << 8) |
+        ((x >> 8) & 0xFF00) | (x >> 24);
+    return x;
+}
+
+
+// Same loop as crc32b, but on a length instead of a null terminated string
+uint32_t crc32_bitwise_update(uint32_t crc, const void *data, size_t len) {
+    const uint8_t *p = (const uint8_t *)data;
+    uint32_t mask;
+
+    while (len--) {
+        crc ^= *p++;
+        for (int j = 7; j >= 0; j--) {    // Do eight times
+            mask = -(crc & 1);
+            crc = (crc >> 1) ^ (CRC32_POLY & mask);
+        }
+    }
+    return crc;
+}
+
+
+// One table lookup per byte, used for the head and tail of the slicing loops
+static inline uint32_t crc32_bytes(const uint32_t (*table)[256], uint32_t crc, const uint8_t *p, size_t len) {
+    while (len--) {
+        crc = (crc >> 8) ^ table[0][(crc ^ *p++) & 0xFF];
+    }
+    return crc;
+}
+
+
+static inline uint32_t crc32_slice8(const uint32_t (*table)[256], uint32_t crc, const uint8_t *p, size_t len) {
+    while (len >= 8) {
+        uint32_t one = crc32_load32(p) ^ crc;
+        uint32_t two = crc32_load32(p + 4);
+        crc = table[7][ one        & 0xFF] ^
+              table[6][(one >>  8) & 0xFF] ^
+              table[5][(one >> 16) & 0xFF] ^
+              table[4][ one >> 24        ] ^
+              table[3][ two        & 0xFF] ^
+              table[2][(two >>  8) & 0xFF] ^
+              table[1][(two >> 16) & 0xFF] ^
+              table[0][ two >> 24        ];
+        p += 8;
+        len -= 8;
+    }
+    return crc32_bytes(table, crc, p, len);
+}
+
+
+static inline uint32_t crc32_slice16(const uint32_t (*table)[256], uint32_t crc, const uint8_t *p, size_t len) {
+    while (len >= 16) {
+        uint32_t one   = crc32_load32(p) ^ crc;
+        uint32_t two   = crc32_load32(p + 4);
+        uint32_t three = crc32_load32(p + 8);
+        uint32_t four  = crc32_load32(p + 12);
+        crc = table[15][ one          & 0xFF] ^
+              table[14][(one   >>  8) & 0xFF] ^
+              table[13][(one   >> 16) & 0xFF] ^
+              table[12][ one   >> 24        ] ^
+              table[11][ two          & 0xFF] ^
+              table[10][(two   >>  8) & 0xFF] ^
+              table[ 9][(two   >> 16) & 0xFF] ^
+              table[ 8][ two   >> 24        ] ^
+              table[ 7][ three        & 0xFF] ^
+              table[ 6][(three >>  8) & 0xFF] ^
+              table[ 5][(three >> 16) & 0xFF] ^
+              table[ 4][ three >> 24        ] ^
+              table[ 3][ four         & 0xFF] ^
+              table[ 2][(four  >>  8) & 0xFF] ^
+              table[ 1][(four  >> 16) & 0xFF] ^
+              table[ 0][ four  >> 24        ];
+        p += 16;
+        len -= 16;
+    }
+    return crc32_bytes(table, crc, p, len);
+}
+
+
+// Not reflected (MSB first) version of crc32_slice8, the register shifts left
+static inline uint32_t crc32_slice8_msb(const uint32_t (*table)[256], uint32_t crc, const uint8_t *p, size_t len) {
+    while (len >= 8) {
+        uint32_t one = crc32_load32_be(p) ^ crc;
+        uint32_t two = crc32_load32_be(p + 4);
+        crc = table[7][ one >> 24        ] ^
+              table[6][(one >> 16) & 0xFF] ^
+              table[5][(one >>  8) & 0xFF] ^
+              table[4][ one        & 0xFF] ^
+              table[3][ two >> 24        ] ^
+              table[2][(two >> 16) & 0xFF] ^
+              table[1][(two >>  8) & 0xFF] ^
+              table[0][ two        & 0xFF];
+        p += 8;
+        len -= 8;
+    }
+    while (len--) {
+        crc = (crc << 8) ^ table[0][((crc >> 24) ^ *p++) & 0xFF];
+    }
+    return crc;
+}
+
+
+uint32_t crc32_table_update(uint32_t crc, const void *data, size_t len) {
+    return crc32_bytes(crc32_table, crc, (const uint8_t *)data, len);
+}
+
+
+static void crc32_halfword_init(void) {
+    uint32_t half, crc;
+
+    if (crc32_halfword_table[1] != 0) return;
+    for (half = 0; half <= 65535; half++) {
+        crc = half;
+        for (int j = 15; j >= 0; j--) {
+            crc = (crc >> 1) ^ (CRC32_POLY & -(crc & 1));
+        }
+        crc32_halfword_table[half] = crc;
+    }
+}
+
+
+uint32_t crc32_halfword_update(uint32_t crc, const void *data, size_t len) {
+    const uint8_t *p = (const uint8_t *)data;
+
+    while (len >= 2) {
+        crc ^= (uint32_t)p[0] | ((uint32_t)p[1] << 8);
+        crc = (crc >> 16) ^ crc32_halfword_table[crc & 0xFFFF];
+        p += 2;
+        len -= 2;
+    }
+    return crc32_bytes(crc32_table, crc, p, len);
+}
+
+
+uint32_t crc32_slice8_update(uint32_t crc, const void *data, size_t len) {
+    return crc32_slice8(crc32_table, crc, (const uint8_t *)data, len);
+}
+
+
+uint32_t crc32_slice16_update(uint32_t crc, const void *data, size_t len) {
+    return crc32_slice16(crc32_table, crc, (const uint8_t *)data, len);
+}
+
+
+/********************************************************************************************************************
+*********************************************************************************************************************
+*****************************************        COMBINE IN GF(2)        ********************************************
+*********************************************************************************************************************
+*********************************************************************************************************************/
+
+
+/* Polynomials over GF(2) are kept in the same reflected form as the CRC
+register: bit 31 is x^0 and bit 0 is x^31. Appending n zero bytes to a
+message multiplies its CRC register by x^(8n) modulo P, so
+   CRC(A.B) = CRC(A) * x^(8 len(B)) mod P  xor  CRC(B)
+(the init and final inversions cancel out, like in zlib's crc32_combine). */
+
+// a * b modulo P
+static uint32_t crc32_multmodp(uint32_t a, uint32_t b, uint32_t poly) {
+    uint32_t m = (uint32_t)1 << 31;
+    uint32_t p = 0;
+
+    for (;;) {
+        if (a & m) {
+            p ^= b;
+            if ((a & (m - 1)) == 0) break;
+        }
+        m >>= 1;
+        b = (b & 1) ? (b >> 1) ^ poly : b >> 1;
+    }
+    return p;
+}
+
+
+// x^(8n) modulo P by square and multiply
+static uint32_t crc32_x8nmodp(uint64_t n, uint32_t poly) {
+    uint32_t p = (uint32_t)1 << 31;     // x^0
+    uint32_t sq = (uint32_t)1 << 23;    // x^8
+
+    while (n) {
+        if (n & 1) p = crc32_multmodp(sq, p, poly);
+        sq = crc32_multmodp(sq, sq, poly);
+        n >>= 1;
+    }
+    return p;
+}
+
+
+uint32_t crc32_combine(uint32_t crc_a, uint32_t crc_b, uint64_t len_b) {
+    return crc32_multmodp(crc32_x8nmodp(len_b, CRC32_POLY), crc_a, CRC32_POLY) ^ crc_b;
+}
+
+
+/* With a start value different from the final XOR the register carries an
+extra (init ^ xorout) * x^(8 len_b) term. Models that are not reflected are
+reflected here, so the same arithmetic can be used. */
+
+uint32_t crc32_model_combine(const struct crc32_model *model, uint32_t crc_a, uint32_t crc_b, uint64_t len_b) {
+    uint32_t poly = crc32_reflect(model->poly);
+    uint32_t fix;
+
+    if (model->refin) {
+        fix = crc32_reflect(model->init) ^ model->xorout;
+    } else {
+        fix = crc32_reflect(model->init ^ model->xorout);
+        crc_a = crc32_reflect(crc_a);
+        crc_b = crc32_reflect(crc_b);
+    }
+
+    uint32_t crc = crc32_multmodp(crc32_x8nmodp(len_b, poly), crc_a ^ fix, poly) ^ crc_b;
+
+    return model->refin ? crc : crc32_reflect(crc);
+}
+
+
+/********************************************************************************************************************
+*********************************************************************************************************************
+*****************************************        ENGINE SELECTION        ********************************************
+*********************************************************************************************************************
+*********************************************************************************************************************/
+
+
+const char *crc32_engine_name(int engine) {
+    if (engine < 0 || engine >= CRC32_ENGINE_COUNT) return "unknown";
+    return crc32_engine_names[engine];
+}
+
+
+int crc32_engine_from_name(const char *name) {
+    for (int i = 0; i < CRC32_ENGINE_COUNT; i++) {
+        if (strcmp(name, crc32_engine_names[i]) == 0) return i;
+    }
+    return -1;
+}
+
+
+int crc32_select_engine(int engine) {
+    switch (engine) {
+        case CRC32_ENGINE_BITWISE: crc32_engine_fn = crc32_bitwise_update; break;
+        case CRC32_ENGINE_SLICE8:  crc32_engine_fn = crc32_slice8_update;  break;
+        case CRC32_ENGINE_SLICE16: crc32_engine_fn = crc32_slice16_update; break;
+        case CRC32_ENGINE_TABLE:   crc32_engine_fn = crc32_table_update;   break;
+        case CRC32_ENGINE_HALFWORD:
+            crc32_halfword_init();
+            crc32_engine_fn = crc32_halfword_update;
+            break;
+        case CRC32_ENGINE_PCLMUL:
+            if (crc32_cpu_features() & CRC32_CPU_PCLMUL) {
+                crc32_engine_fn = crc32_pclmul_update;
+            } else {
+                crc32_engine_fn = crc32_slice16_update;     // No PCLMULQDQ on this CPU
+                engine = CRC32_ENGINE_SLICE16;
+            }
+            break;
+        case CRC32_ENGINE_VPCLMUL:
+            if (crc32_cpu_features() & CRC32_CPU_VPCLMUL) {
+                crc32_engine_fn = crc32_vpclmul_update;
+            } else {
+                return crc32_select_engine(CRC32_ENGINE_PCLMUL);  // No AVX-512 VPCLMULQDQ
+            }
+            break;
+        default: return -1;
+    }
+    crc32_engine = engine;
+    return 0;
+}
+
+
+int crc32_current_engine(void) {
+    if (crc32_engine < 0) crc32_select_engine(CRC32_DEFAULT_ENGINE);
+    return crc32_engine;
+}
+
+
+// First call only, no test on the following ones
+static uint32_t crc32_resolve_update(uint32_t crc, const void *data, size_t len) {
+    crc32_select_engine(CRC32_DEFAULT_ENGINE);
+    return crc32_engine_fn(crc, data, len);
+}
+
+
+uint32_t crc32_update(uint32_t crc, const void *data, size_t len) {
+    return crc32_engine_fn(crc, data, len);
+}
+
+
+uint32_t crc32_compute(const void *data, size_t len) {
+    return crc32_final(crc32_update(CRC32_INIT, data, len));
+}
+
+
+/********************************************************************************************************************
+*********************************************************************************************************************
+*****************************************        CRC-32 MODELS        ***********************************************
+*********************************************************************************************************************
+*********************************************************************************************************************/
+
+
+uint32_t crc32c_slice16_update(uint32_t crc, const void *data, size_t len) {
+    return crc32_slice16(crc32_table_castagnoli, crc, (const uint8_t *)data, len);
+}
+
+
+static uint32_t crc32c_resolve_update(uint32_t crc, const void *data, size_t len);
+
+// Starts on the resolver like crc32_engine_fn, SSE4.2 or tables from then on
+static crc32_update_fn crc32c_engine_fn = crc32c_resolve_update;
+
+static uint32_t crc32c_resolve_update(uint32_t crc, const void *data, size_t len) {
+    if (crc32_cpu_features() & CRC32_CPU_SSE42) {
+        crc32c_engine_fn = crc32c_sse42_update;
+    } else {
+        crc32c_engine_fn = crc32c_slice16_update;
+    }
+    return crc32c_engine_fn(crc, data, len);
+}
+
+
+uint32_t crc32c_update(uint32_t crc, const void *data, size_t len) {
+    return crc32c_engine_fn(crc, data, len);
+}
+
+
+// crc32_model_ieee uses the selected IEEE engine (pclmul, slice16, ...) and
+// crc32_model_castagnoli the SSE4.2 instruction when there is one,
+// the others the generic slicing loops on their own tables
+#define CRC32_UPDATE_ieee crc32_update
+#define CRC32_UPDATE_castagnoli crc32c_update
+#define CRC32_UPDATE_koopman NULL
+#define CRC32_UPDATE_bzip2 NULL
+
+#define CRC32_DEFINE_MODEL(name, poly, refin, refout, init, xorout, check) \
+    const struct crc32_model crc32_model_##name = { \
+        #name, poly, refin, refout, init, xorout, check, crc32_table_##name, CRC32_UPDATE_##name \
+    };
+CRC32_MODEL_LIST(CRC32_DEFINE_MODEL)
+
+#define CRC32_LIST_MODEL(name, poly, refin, refout, init, xorout, check) &crc32_model_##name,
+const struct crc32_model *const crc32_models[] = {
+    CRC32_MODEL_LIST(CRC32_LIST_MODEL)
+    NULL
+};
+
+
+// Names used on the command line for the common models
+static const char *crc32_model_aliases[][2] = {
+    { "crc32",  "ieee" },
+    { "crc32c", "castagnoli" },
+    { "crc32k", "koopman" }
+};
+
+
+const struct crc32_model *crc32_model_from_name(const char *name) {
+    for (size_t i = 0; i < sizeof(crc32_model_aliases) / sizeof(crc32_model_aliases[0]); i++) {
+        if (strcmp(name, crc32_model_aliases[i][0]) == 0) name = crc32_model_aliases[i][1];
+    }
+    for (int i = 0; crc32_models[i] != NULL; i++) {
+        if (strcmp(name, crc32_models[i]->name) == 0) return crc32_models[i];
+    }
+    return NULL;
+}
+
+
+uint32_t crc32_model_start(const struct crc32_model *model) {
+    return model->refin ? crc32_reflect(model->init) : model->init;
+}
+
+
+uint32_t crc32_model_update(const struct crc32_model *model, uint32_t crc, const void *data, size_t len) {
+    if (model->update) return model->update(crc, data, len);
+    if (!model->refin) return crc32_slice8_msb(model->table, crc, (const uint8_t *)data, len);
+    return crc32_slice16(model->table, crc, (const uint8_t *)data, len);
+}
+
+
+uint32_t crc32_model_finish(const struct crc32_model *model, uint32_t crc) {
+    if (model->refin != model->refout) crc = crc32_reflect(crc);
+    return crc ^ model->xorout;
+}
+
+
+uint32_t crc32_model_compute(const struct crc32_model *model, const void *data, size_t len) {
+    uint32_t crc = crc32_model_update(model, crc32_model_start(model), data, len);
+    return crc32_model_finish(model, crc);
+}
+
+
+void crc32_model_store(const struct crc32_model *model, uint32_t crc, uint8_t trailer[4]) {
+    for (int i = 0; i < 4; i++) {
+        int shift = model->refout ? 8 * i : 24 - 8 * i;
+        trailer[i] = (uint8_t)(crc >> shift);
+    }
+}
+
+
+// The residue does not depend on the data, the empty message is enough
+uint32_t crc32_model_residue(const struct crc32_model *model) {
+    uint8_t trailer[4];
+
+    crc32_model_store(model, crc32_model_finish(model, crc32_model_start(model)), trailer);
+    return crc32_model_compute(model, trailer, 4);
+}
@@ -0,0 +1,144 @@
+#ifndef __CRC32_H__
+#define __CRC32_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "CRC32_MODELS.h"
+
+// CRC-32 (IEEE 802.3, PKZip) reflected polynomial, same as crc32b in CRC32_BIBLE.c
+#define CRC32_POLY 0xEDB88320
+#define CRC32_INIT 0xFFFFFFFF
+
+// Engines that can be selected at run time with crc32_select_engine()
+#define CRC32_ENGINE_BITWISE  0     // crc32b, 8 shift/mask steps per byte
+#define CRC32_ENGINE_SLICE8   1     // 8 bytes per step, first 8 of the 256 entry tables (8 KB)
+#define CRC32_ENGINE_SLICE16  2     // 16 bytes per step, 16 x 256 entry tables (16 KB)
+#define CRC32_ENGINE_PCLMUL   3     // x86 carry-less multiply folding (falls back to slice16)
+#define CRC32_ENGINE_VPCLMUL  4     // AVX-512 VPCLMULQDQ wide folding (falls back to pclmul)
+#define CRC32_ENGINE_TABLE    5     // crc32c, one lookup per byte in a 256 entry table (1 KB)
+#define CRC32_ENGINE_HALFWORD 6     // crc32d, one lookup per halfword in a 64K entry table (256 KB)
+#define CRC32_ENGINE_COUNT    7
+
+// Build time default engine (override with -DCRC32_DEFAULT_ENGINE=CRC32_ENGINE_SLICE8)
+// The x86 engines are only used when CPUID says the instructions are there.
+#ifndef CRC32_DEFAULT_ENGINE
+#define CRC32_DEFAULT_ENGINE CRC32_ENGINE_VPCLMUL
+#endif
+
+// Buffers shorter than this go through the 128-bit kernel in the vpclmul engine
+#ifndef CRC32_WIDE_THRESHOLD
+#define CRC32_WIDE_THRESHOLD 2048
+#endif
+
+// CPU features reported by crc32_cpu_features() (CRC32_X86.c)
+#define CRC32_CPU_PCLMUL      0x01  // PCLMULQDQ + SSE4.1
+#define CRC32_CPU_VPCLMUL     0x02  // VPCLMULQDQ + AVX512F, enabled by the OS
+#define CRC32_CPU_SSE42       0x04  // SSE4.2 crc32 instruction (CRC-32C only)
+
+// All the update functions work on the raw CRC register, exactly like the loop
+// in compute_file_crc: start with CRC32_INIT, feed the data in as many pieces
+// as you want, and invert the register at the end (crc32_final).
+typedef uint32_t (*crc32_update_fn)(uint32_t crc, const void *data, size_t len);
+
+uint32_t crc32_bitwise_update(uint32_t crc, const void *data, size_t len);
+uint32_t crc32_slice8_update(uint32_t crc, const void *data, size_t len);
+uint32_t crc32_slice16_update(uint32_t crc, const void *data, size_t len);
+uint32_t crc32_pclmul_update(uint32_t crc, const void *data, size_t len);
+uint32_t crc32_vpclmul_update(uint32_t crc, const void *data, size_t len);
+uint32_t crc32_table_update(uint32_t crc, const void *data, size_t len);
+uint32_t crc32_halfword_update(uint32_t crc, const void *data, size_t len);   // After crc32_select_engine(CRC32_ENGINE_HALFWORD)
+
+void crc32_set_wide_threshold(size_t bytes);  // Default CRC32_WIDE_THRESHOLD, minimum 256
+
+int crc32_cpu_features(void);
+const char *crc32_cpu_name(void);       // CPUID brand string, "unknown" if there is none
+
+// Return 0 on success, -1 for unknown engine. An engine the CPU can not run
+// is replaced by slice16, crc32_current_engine() tells which one is in use.
+int crc32_select_engine(int engine);
+int crc32_current_engine(void);
+const char *crc32_engine_name(int engine);
+int crc32_engine_from_name(const char *name); // Return -1 if the name is unknown
+
+// CRC-32C (Castagnoli) register updates, same convention as above with the
+// 0x82F63B78 reflected polynomial. crc32c_update uses the SSE4.2 kernel when
+// the CPU has it and the slicing-by-16 tables otherwise.
+uint32_t crc32c_slice16_update(uint32_t crc, const void *data, size_t len);
+uint32_t crc32c_sse42_update(uint32_t crc, const void *data, size_t len);
+uint32_t crc32c_update(uint32_t crc, const void *data, size_t len);
+
+// Name of the file where crc32_autotune() keeps the fastest engine of each CPU
+#ifndef CRC32_TUNE_FILE
+#define CRC32_TUNE_FILE "CRC32TUNE.TXT"
+#endif
+
+#define CRC32_TUNE_SAMPLE (64u << 10)   // Bytes CRCed by each engine during the calibration
+
+// Selects the fastest engine for this CPU and returns it. The first run times
+// every engine on a CRC32_TUNE_SAMPLE buffer and saves the winner in the file
+// as "<engine> <cpu name>" lines, later runs on the same CPU model read it
+// back. retune = 1 ignores the saved result and calibrates again.
+int crc32_autotune(const char *tune_file, int retune);
+
+// tune_file next to the program (argv[0]), for the tools started by drag and drop
+void crc32_tune_path(char *path, size_t size, const char *argv0);
+
+// Update with the currently selected engine
+uint32_t crc32_update(uint32_t crc, const void *data, size_t len);
+
+// One shot CRC-32 of a buffer (init, update and final inversion)
+uint32_t crc32_compute(const void *data, size_t len);
+
+#define crc32_final(crc) (~(uint32_t)(crc))
+
+// CRC of A followed by B, from crc_a = CRC(A), crc_b = CRC(B) and the length
+// of B (finished CRC values, as returned by crc32_compute). Lets the parts of
+// a file be computed independently and merged in O(log len_b).
+uint32_t crc32_combine(uint32_t crc_a, uint32_t crc_b, uint64_t len_b);
+
+
+// Parameterized CRC-32 models from CRC32_MODELS.h. Their slicing tables are
+// constant data generated ahead of time (CRC32_TABLES.h), so a model is ready
+// to use without any setup and can be shared between threads.
+struct crc32_model {
+    const char *name;
+    uint32_t poly;                  // Normal (MSB first) form, e.g. 0x04C11DB7
+    uint8_t refin;                  // Bytes enter LSB first, register shifts right
+    uint8_t refout;                 // Register is reflected before the final XOR
+    uint32_t init;
+    uint32_t xorout;
+    uint32_t check;                 // CRC of "123456789"
+    const uint32_t (*table)[256];   // CRC32_MODEL_SLICES x 256 entries
+    crc32_update_fn update;         // Faster engine for this model, or NULL
+};
+
+#define CRC32_DECLARE_MODEL(name, poly, refin, refout, init, xorout, check) \
+    extern const struct crc32_model crc32_model_##name;
+CRC32_MODEL_LIST(CRC32_DECLARE_MODEL)
+
+extern const struct crc32_model *const crc32_models[];     // NULL terminated
+
+// Model by name ("ieee", "castagnoli", ...) or short name ("crc32", "crc32c",
+// "crc32k"), NULL if unknown
+const struct crc32_model *crc32_model_from_name(const char *name);
+
+// Same pattern as crc32_update: start, update as many times as needed, finish
+uint32_t crc32_model_start(const struct crc32_model *model);
+uint32_t crc32_model_update(const struct crc32_model *model, uint32_t crc, const void *data, size_t len);
+uint32_t crc32_model_finish(const struct crc32_model *model, uint32_t crc);
+uint32_t crc32_model_compute(const struct crc32_model *model, const void *data, size_t len);
+
+// Binary trailer: the CRC stored in 4 bytes in the order the model shifts
+// them in (least significant first when reflected). The CRC of data followed
+// by its trailer is always crc32_model_residue(), e.g. 0x2144DF1C for CRC-32,
+// so a check is one pass over the whole file, without looking ahead.
+void crc32_model_store(const struct crc32_model *model, uint32_t crc, uint8_t trailer[4]);
+uint32_t crc32_model_residue(const struct crc32_model *model);
+
+// crc32_combine for any model (refin must equal refout)
+uint32_t crc32_model_combine(const struct crc32_model *model, uint32_t crc_a, uint32_t crc_b, uint64_t len_b);
+
+#endif // CRC32_H
@@ -0,0 +1,187 @@
+/*
+    Generates CRC32_TABLES.h, the constant slicing tables of every model in
+    CRC32_MODELS.h, so the CRC code has no table setup at run time (no
+    "if (table[1] == 0)" test on each call, nothing to race on between
+    threads, and the tables can stay in flash on the microcontroller).
+
+    Build and run from the CRC32 folder:
+        gcc CRC32_MAKE_TABLES.c -o CRC32_MAKE_TABLES
+        CRC32_MAKE_TABLES > CRC32_TABLES.h
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "CRC32_MODELS.h"
+
+
+// Reverses (reflects) bits in a 32-bit word, like reverse() in CRC32_BIBLE.c
+static uint32_t reflect32(uint32_t x) {
+    x = ((x & 0x55555555) <<  1) | ((x >>  1) & 0x55555555);
+    x = ((x & 0x33333333) <<  2) | ((x >>  2) & 0x33333333);
+    x = ((x & 0x0F0F0F0F) <<  4) | ((x >>  4) & 0x0F0F0F0F);
+    x = (x << 24) | ((x & 0xFF00) << 8) |
+        ((x >> 8) & 0xFF00) | (x >> 24);
+    return x;
+}
+
+
+static void make_table(const char *name, uint32_t poly, int refin) {
+    uint32_t table[CRC32_MODEL_SLICES][256];
+    uint32_t byte, crc;
+    int j, k;
+
+    for (byte = 0; byte <= 255; byte++) {
+        if (refin) {                    // Shift right with the reflected polynomial (crc32b)
+            crc = byte;
+            for (j = 7; j >= 0; j--) {
+                crc = (crc >> 1) ^ (reflect32(poly) & -(crc & 1));
+            }
+        } else {                        // Shift left with the normal polynomial (crc32a)
+            crc = byte << 24;
+            for (j = 7; j >= 0; j--) {
+                crc = (crc << 1) ^ (poly & -(crc >> 31));
+            }
+        }
+        table[0][byte] = crc;
+    }
+
+    // table[k][n] is the CRC of byte n followed by k zero bytes
+    for (byte = 0; byte <= 255; byte++) {
+        crc = table[0][byte];
+        for (k = 1; k < CRC32_MODEL_SLICES; k++) {
+            if (refin) crc = (crc >> 8) ^ table[0][crc & 0xFF];
+            else       crc = (crc << 8) ^ table[0][crc >> 24];
+            table[k][byte] = crc;
+        }
+    }
+
+    printf("static const uint32_t crc32_table_%s[%d][256] = {\n", name, CRC32_MODEL_SLICES);
+    for (k = 0; k < CRC32_MODEL_SLICES; k++) {
+        printf("  {\n");
+        for (byte = 0; byte <= 255; byte++) {
+            printf("%s0x%08X%s", (byte % 6 == 0) ? "    " : "",
+                   table[k][byte], (byte == 255) ? "\n" : (byte % 6 == 5) ? ",\n" : ", ");
+        }
+        printf("  }%s\n", (k == CRC32_MODEL_SLICES - 1) ? "" : ",");
+    }
+    printf("};\n\n");
+}
+
+
+// a * b mod p in the reflected domain (x^0 is the top bit), as in CRC32.c
+static uint32_t multmodp(uint32_t a, uint32_t b, uint32_t p) {
+    uint32_t m = (uint32_t)1 << 31, prod = 0;
+
+    for (;;) {
+        if (a & m) {
+            prod ^= b;
+            if ((a & (m - 1)) == 0) break;
+        }
+        m >>= 1;
+        b = (b & 1) ? (b >> 1) ^ p : b >> 1;
+    }
+    return prod;
+}
+
+
+// Tables to multiply a reflected CRC register by x^(8 len) mod poly one byte at a
+// time: shifting the CRC of a stream over len zero bytes is four lookups.
+static void make_shift_table(const char *name, uint32_t poly, uint32_t len) {
+    uint32_t p = reflect32(poly);
+    uint32_t xn = (uint32_t)1 << 31, sq = (uint32_t)1 << 30;     // x^0, x^1
+    uint32_t n = len * 8;
+    int k, byte;
+
+    while (n) {
+        if (n & 1) xn = multmodp(sq, xn, p);
+        sq = multmodp(sq, sq, p);
+        n >>= 1;
+    }
+
+    printf("static const uint32_t %s[4][256] = {\n", name);
+    for (k = 0; k < 4; k++) {
+        printf("  {\n");
+        for (byte = 0; byte <= 255; byte++) {
+            printf("%s0x%08X%s", (byte % 6 == 0) ? "    " : "",
+                   multmodp(xn, (uint32_t)byte << (8 * k), p),
+                   (byte == 255) ? "\n" : (byte % 6 == 5) ? ",\n" : ", ");
+        }
+        printf("  }%s\n", (k == 3) ? "" : ",");
+    }
+    printf("};\n\n");
+}
+
+
+// Tables of the CRC-32 engines for the microcontroller (CRC32_TIERS.c): the 16
+// entry nibble table and the 4 x 256 slicing table. Rows 1 to 3 are only
+// compiled for the slice4 tier (CRC32_TIER_ROWS = 4), the byte tier keeps row 0.
+static void make_tier_tables(void) {
+    uint32_t poly = reflect32(0x04C11DB7);
+    uint32_t table[4][256];
+    uint32_t byte, crc;
+    int j, k;
+
+    printf("static const uint32_t crc32_tier_nibble[16] = {\n");
+    for (byte = 0; byte < 16; byte++) {
+        crc = byte;
+        for (j = 3; j >= 0; j--) {
+            crc = (crc >> 1) ^ (poly & -(crc & 1));
+        }
+        printf("%s0x%08X%s", (byte % 6 == 0) ? "    " : "",
+               crc, (byte == 15) ? "\n" : (byte % 6 == 5) ? ",\n" : ", ");
+    }
+    printf("};\n\n");
+
+    for (byte = 0; byte <= 255; byte++) {
+        crc = byte;
+        for (j = 7; j >= 0; j--) {
+            crc = (crc >> 1) ^ (poly & -(crc & 1));
+        }
+        table[0][byte] = crc;
+    }
+    for (byte = 0; byte <= 255; byte++) {
+        crc = table[0][byte];
+        for (k = 1; k < 4; k++) {
+            crc = (crc >> 8) ^ table[0][crc & 0xFF];
+            table[k][byte] = crc;
+        }
+    }
+
+    printf("static const uint32_t crc32_tier_table[CRC32_TIER_ROWS][256] = {\n");
+    for (k = 0; k < 4; k++) {
+        if (k == 1) printf("#if CRC32_TIER_ROWS > 1\n");
+        printf("  %s{\n", (k == 0) ? "" : ", ");
+        for (byte = 0; byte <= 255; byte++) {
+            printf("%s0x%08X%s", (byte % 6 == 0) ? "    " : "",
+                   table[k][byte], (byte == 255) ? "\n" : (byte % 6 == 5) ? ",\n" : ", ");
+        }
+        printf("  }\n");
+    }
+    printf("#endif\n");
+    printf("};\n\n");
+}
+
+
+#define MAKE_TABLE(name, poly, refin, refout, init, xorout, check) make_table(#name, poly, refin);
+
+int main(void) {
+    printf("#ifndef __CRC32_TABLES_H__\n");
+    printf("#define __CRC32_TABLES_H__\n\n");
+    printf("// Generated by CRC32_MAKE_TABLES.c from CRC32_MODELS.h, do not edit.\n\n");
+    printf("#include <stdint.h>\n\n");
+
+    // CRC32_X86.c only wants the shift tables, CRC32_TIERS.c the small tier
+    // tables, the other files the model tables
+    printf("#if !defined(CRC32_TABLES_CRC32C_SHIFT) && !defined(CRC32_TABLES_TIERS)\n\n");
+    CRC32_MODEL_LIST(MAKE_TABLE)
+    printf("#elif defined(CRC32_TABLES_CRC32C_SHIFT)\n\n");
+    make_shift_table("crc32c_shift_long", 0x1EDC6F41, CRC32C_LONG);
+    make_shift_table("crc32c_shift_short", 0x1EDC6F41, CRC32C_SHORT);
+    printf("#else // CRC32_TABLES_TIERS\n\n");
+    make_tier_tables();
+    printf("#endif // CRC32_TABLES_CRC32C_SHIFT, CRC32_TABLES_TIERS\n\n");
+
+    printf("#endif // CRC32_TABLES_H\n");
+    return 0;
+}
@@ -0,0 +1,26 @@
+#ifndef __CRC32_MODELS_H__
+#define __CRC32_MODELS_H__
+
+// The CRC-32 variants with built in tables, in the usual Rocksoft/reveng
+// notation: polynomial in normal (MSB first) form, input/output reflection,
+// register start value, final XOR and the CRC of the ASCII string "123456789".
+// CRC32_MAKE_TABLES.c generates CRC32_TABLES.h from this list, so after
+// adding a line here run it again:  CRC32_MAKE_TABLES > CRC32_TABLES.h
+//
+//   X(name,       poly,       refin, refout, init,       xorout,     check)
+
+#define CRC32_MODEL_LIST(X) \
+    X(ieee,        0x04C11DB7, 1,     1,      0xFFFFFFFF, 0xFFFFFFFF, 0xCBF43926) /* CRC-32, PKZip, Ethernet, crc32b */ \
+    X(castagnoli,  0x1EDC6F41, 1,     1,      0xFFFFFFFF, 0xFFFFFFFF, 0xE3069283) /* CRC-32C, iSCSI, SSE4.2 crc32  */ \
+    X(koopman,     0x741B8CD7, 1,     1,      0xFFFFFFFF, 0xFFFFFFFF, 0x2D3DD0AE) /* CRC-32K                       */ \
+    X(bzip2,       0x04C11DB7, 0,     0,      0xFFFFFFFF, 0xFFFFFFFF, 0xFC891918) /* CRC-32/BZIP2, crc32a circuit  */
+
+// Slicing tables generated per model
+#define CRC32_MODEL_SLICES 16
+
+// Stream lengths of the SSE4.2 CRC-32C kernel, CRC32_TABLES.h has the tables
+// that shift a CRC over this many zero bytes (see crc32c_sse42_update)
+#define CRC32C_LONG  8192
+#define CRC32C_SHORT 256
+
+#endif // CRC32_MODELS_H
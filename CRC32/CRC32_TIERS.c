@@ -0,0 +1,124 @@
+#include <stdint.h>
+#include "CRC32_TIERS.h"
+
+// The slicing tier needs 4 table rows, the byte tier only the first one
+#if !defined(CRC32_TIER) || CRC32_TIER == CRC32_TIER_SLICE4
+#define CRC32_TIER_ROWS 4
+#else
+#define CRC32_TIER_ROWS 1
+#endif
+
+#define CRC32_TABLES_TIERS      // Only the tier tables, not the 16 KB model tables
+#include "CRC32_TABLES.h"
+
+#define CRC32_TIER_POLY 0xEDB88320
+
+
+#if !defined(CRC32_TIER) || CRC32_TIER == CRC32_TIER_TABLELESS
+
+// crc32h on a length: the 8 table entries for the bits of the low byte are
+// built from the polynomial and selected with masks, no memory access but the data
+uint32_t crc32_tableless_update(uint32_t crc, const void *data, size_t len) {
+    const uint8_t *p = (const uint8_t *)data;
+    const uint32_t g0 = CRC32_TIER_POLY, g1 = g0 >> 1,
+        g2 = g0 >> 2, g3 = g0 >> 3, g4 = g0 >> 4, g5 = g0 >> 5,
+        g6 = (g0 >> 6) ^ g0, g7 = ((g0 >> 6) ^ g0) >> 1;
+    uint32_t c;
+
+    while (len--) {
+        crc ^= *p++;
+        c = (-(crc      & 1) & g7) ^ (-(crc >> 1 & 1) & g6) ^
+            (-(crc >> 2 & 1) & g5) ^ (-(crc >> 3 & 1) & g4) ^
+            (-(crc >> 4 & 1) & g3) ^ (-(crc >> 5 & 1) & g2) ^
+            (-(crc >> 6 & 1) & g1) ^ (-(crc >> 7 & 1) & g0);
+        crc = (crc >> 8) ^ c;
+    }
+    return crc;
+}
+
+#endif
+
+
+#if !defined(CRC32_TIER) || CRC32_TIER == CRC32_TIER_NIBBLE
+
+// crc32e with the 16-way switch replaced by its 16 entry table
+uint32_t crc32_nibble_update(uint32_t crc, const void *data, size_t len) {
+    const uint8_t *p = (const uint8_t *)data;
+
+    while (len--) {
+        crc ^= *p++;
+        crc = (crc >> 4) ^ crc32_tier_nibble[crc & 0xF];
+        crc = (crc >> 4) ^ crc32_tier_nibble[crc & 0xF];
+    }
+    return crc;
+}
+
+#endif
+
+
+#if !defined(CRC32_TIER) || CRC32_TIER == CRC32_TIER_BYTE || CRC32_TIER == CRC32_TIER_SLICE4
+
+// crc32c, also the head and tail of the slice4 loop
+uint32_t crc32_byte_update(uint32_t crc, const void *data, size_t len) {
+    const uint8_t *p = (const uint8_t *)data;
+
+    while (len--) {
+        crc = (crc >> 8) ^ crc32_tier_table[0][(crc ^ *p++) & 0xFF];
+    }
+    return crc;
+}
+
+#endif
+
+
+#if !defined(CRC32_TIER) || CRC32_TIER == CRC32_TIER_SLICE4
+
+// crc32_slice8 of CRC32.c on one word, the loads are byte wide so the data
+// can be at any address and the result does not depend on the endianness
+uint32_t crc32_slice4_update(uint32_t crc, const void *data, size_t len) {
+    const uint8_t *p = (const uint8_t *)data;
+
+    while (len >= 4) {
+        crc ^= (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+        crc = crc32_tier_table[3][ crc        & 0xFF] ^
+              crc32_tier_table[2][(crc >>  8) & 0xFF] ^
+              crc32_tier_table[1][(crc >> 16) & 0xFF] ^
+              crc32_tier_table[0][ crc >> 24        ];
+        p += 4;
+        len -= 4;
+    }
+    return crc32_byte_update(crc, p, len);
+}
+
+#endif
+
+
+#ifndef CRC32_TIER
+
+const struct crc32_tier crc32_tiers[CRC32_TIER_COUNT] = {
+    { "tableless", 0,                                  crc32_tableless_update },
+    { "nibble",    sizeof(crc32_tier_nibble),          crc32_nibble_update },
+    { "byte",      sizeof(crc32_tier_table[0]),        crc32_byte_update },
+    { "slice4",    sizeof(crc32_tier_table),           crc32_slice4_update }
+};
+
+// On the PC the tier is only used for the report, slice4 stands for the set
+uint32_t crc32_tier_update(uint32_t crc, const void *data, size_t len) {
+    return crc32_slice4_update(crc, data, len);
+}
+
+#else
+
+uint32_t crc32_tier_update(uint32_t crc, const void *data, size_t len) {
+#if CRC32_TIER == CRC32_TIER_TABLELESS
+    return crc32_tableless_update(crc, data, len);
+#elif CRC32_TIER == CRC32_TIER_NIBBLE
+    return crc32_nibble_update(crc, data, len);
+#elif CRC32_TIER == CRC32_TIER_BYTE
+    return crc32_byte_update(crc, data, len);
+#else
+    return crc32_slice4_update(crc, data, len);
+#endif
+}
+
+#endif // CRC32_TIER
@@ -0,0 +1,45 @@
+#ifndef __CRC32_TIERS_H__
+#define __CRC32_TIERS_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* CRC-32 (IEEE, same result as crc32b) engines for the microcontroller that
+reads the 25Q32 flash, ordered by the size of their constant table. The
+halfword and slicing-by-16 engines of CRC32.c (256 KB, 16 KB) do not fit there.
+
+On the microcontroller compile CRC32_TIERS.c with one tier, e.g.
+    -DCRC32_TIER=CRC32_TIER_NIBBLE
+and only that engine and its table are built, as crc32_tier_update.
+Without CRC32_TIER (on the PC) all of them are built, for CRC32Bench --tiers
+to print the bytes per cycle of each one against its table size. */
+
+#define CRC32_TIER_TABLELESS  0     // crc32h, 8 masked XORs per byte, no table
+#define CRC32_TIER_NIBBLE     1     // Two lookups per byte in a 16 entry table (64 B)
+#define CRC32_TIER_BYTE       2     // crc32c, one lookup per byte in a 256 entry table (1 KB)
+#define CRC32_TIER_SLICE4     3     // 4 bytes per step, 4 x 256 entry tables (4 KB)
+#define CRC32_TIER_COUNT      4
+
+// Same register convention as crc32_update: start with 0xFFFFFFFF, feed the
+// data in pieces, invert at the end
+uint32_t crc32_tier_update(uint32_t crc, const void *data, size_t len);
+
+// The engines themselves, only the ones of the CRC32_TIER build are there
+uint32_t crc32_tableless_update(uint32_t crc, const void *data, size_t len);
+uint32_t crc32_nibble_update(uint32_t crc, const void *data, size_t len);
+uint32_t crc32_byte_update(uint32_t crc, const void *data, size_t len);
+uint32_t crc32_slice4_update(uint32_t crc, const void *data, size_t len);
+
+#ifndef CRC32_TIER
+
+struct crc32_tier {
+    const char *name;
+    size_t table_bytes;             // Constant data read by the engine
+    uint32_t (*update)(uint32_t crc, const void *data, size_t len);
+};
+
+extern const struct crc32_tier crc32_tiers[CRC32_TIER_COUNT];
+
+#endif // CRC32_TIER
+
+#endif // CRC32_TIERS_H
@@ -0,0 +1,132 @@
+
+#include <stdio.h>
+#include <stdint.h>
+#include "CRC32.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+// Startup calibration: which engine is fastest depends on the CPU (PCLMULQDQ,
+// AVX-512) and on its caches (the 256 KB halfword table of crc32d does not fit
+// in L1/L2 on most of them), so it is measured once per CPU model and saved.
+
+#define CRC32_TUNE_TIME   0.002     // Seconds spent on each engine, best of 3
+#define CRC32_TUNE_LINES  32        // CPU models kept in the file
+
+
+// Wall clock in seconds
+static double crc32_tune_now(void) {
+#ifdef _WIN32
+    LARGE_INTEGER freq, count;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    return (double)count.QuadPart / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
+
+// Bytes per second of the selected engine on the sample
+static double crc32_tune_engine(const uint8_t *sample, size_t size) {
+    volatile uint32_t sink = 0;
+    double best = 0;
+
+    for (int run = 0; run < 3; run++) {
+        uint32_t rounds = 0;
+        double elapsed, start = crc32_tune_now();
+        do {
+            sink ^= crc32_update(CRC32_INIT, sample, size);
+            rounds++;
+            elapsed = crc32_tune_now() - start;
+        } while (elapsed < CRC32_TUNE_TIME);
+
+        double speed = (double)size * rounds / elapsed;
+        if (speed > best) best = speed;
+    }
+    (void)sink;
+    return best;
+}
+
+
+// Time every engine the CPU can run, return the fastest
+static int crc32_calibrate(void) {
+    int best_engine = CRC32_ENGINE_SLICE16;
+    double best = 0;
+
+    uint8_t *sample = (uint8_t *)malloc(CRC32_TUNE_SAMPLE);
+    if (sample == NULL) return best_engine;
+    for (size_t i = 0; i < CRC32_TUNE_SAMPLE; i++) {
+        sample[i] = (uint8_t)(i * 131 + (i >> 8));
+    }
+
+    for (int engine = 0; engine < CRC32_ENGINE_COUNT; engine++) {
+        // Skip the engines replaced by a fallback on this CPU
+        if (crc32_select_engine(engine) != 0 || crc32_current_engine() != engine) continue;
+
+        double speed = crc32_tune_engine(sample, CRC32_TUNE_SAMPLE);
+        if (speed > best) {
+            best = speed;
+            best_engine = engine;
+        }
+    }
+
+    free(sample);
+    return best_engine;
+}
+
+
+int crc32_autotune(const char *tune_file, int retune) {
+    char lines[CRC32_TUNE_LINES][128];
+    char line[128];
+    int count = 0, engine = -1;
+    const char *cpu = crc32_cpu_name();
+
+    // Keep the lines of the other CPU models, take the engine of this one
+    FILE *file = fopen(tune_file, "r");
+    if (file) {
+        while (fgets(line, sizeof(line), file)) {
+            line[strcspn(line, "\r\n")] = 0;
+            char *name = strchr(line, ' ');
+            if (name == NULL) continue;
+
+            // "<engine> <cpu>", the other lines are kept as they are
+            if (strcmp(name + 1, cpu) == 0) {
+                *name = 0;
+                if (!retune) engine = crc32_engine_from_name(line);
+            } else if (count < CRC32_TUNE_LINES) {
+                memcpy(lines[count++], line, sizeof(line));
+            }
+        }
+        fclose(file);
+    }
+
+    if (engine >= 0 && crc32_select_engine(engine) == 0 && crc32_current_engine() == engine) {
+        return engine;
+    }
+
+    // Not known yet (or an engine this build does not have): measure and save
+    engine = crc32_calibrate();
+    crc32_select_engine(engine);
+
+    file = fopen(tune_file, "w");
+    if (file) {
+        for (int i = 0; i < count; i++) fprintf(file, "%s\n", lines[i]);
+        fprintf(file, "%s %s\n", crc32_engine_name(engine), cpu);
+        fclose(file);
+    }
+    return engine;
+}
+
+
+void crc32_tune_path(char *path, size_t size, const char *argv0) {
+    const char *end = argv0 + strlen(argv0);
+
+    while (end > argv0 && end[-1] != '/' && end[-1] != '\\') end--;
+    snprintf(path, size, "%.*s%s", (int)(end - argv0), argv0, CRC32_TUNE_FILE);
+}
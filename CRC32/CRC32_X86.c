@@ -0,0 +1,415 @@
+
+#include <stdint.h>
+#include "CRC32.h"
+
+// x86 only kernels, built with per function target attributes so the rest of
+// the program keeps the plain -m32 code generation and still runs on any CPU.
+// The CPU is checked with CPUID before any of these functions is selected.
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CRC32_HAVE_X86 1
+#include <cpuid.h>
+#include <immintrin.h>
+#define CRC32_TABLES_CRC32C_SHIFT      // Only the CRC-32C shift tables
+#include "CRC32_TABLES.h"
+#endif
+
+
+#ifdef CRC32_HAVE_X86
+
+int crc32_cpu_features(void) {
+    static int features = -1;
+    unsigned int eax, ebx, ecx, edx;
+
+    if (features >= 0) return features;
+
+    features = 0;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return features;
+
+    if ((ecx & bit_PCLMUL) && (ecx & bit_SSE4_1)) features |= CRC32_CPU_PCLMUL;
+    if (ecx & bit_SSE4_2) features |= CRC32_CPU_SSE42;
+
+    // AVX-512 also needs the OS to save the zmm registers (XCR0 bits 1,2,5,6,7)
+    if ((features & CRC32_CPU_PCLMUL) && (ecx & bit_OSXSAVE)) {
+        unsigned int xcr0_lo, xcr0_hi;
+        __asm__ ("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+        if ((xcr0_lo & 0xE6) == 0xE6 && __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+            if ((ebx & bit_AVX512F) && (ecx & bit_VPCLMULQDQ)) features |= CRC32_CPU_VPCLMUL;
+        }
+    }
+    return features;
+}
+
+
+const char *crc32_cpu_name(void) {
+    static char name[49];
+    unsigned int regs[12];
+
+    if (name[0] != 0) return name;
+
+    if (__get_cpuid_max(0x80000000, NULL) < 0x80000004) {
+        strcpy(name, "unknown");
+        return name;
+    }
+    for (unsigned int leaf = 0; leaf < 3; leaf++) {
+        __get_cpuid(0x80000002 + leaf, &regs[leaf * 4], &regs[leaf * 4 + 1],
+                    &regs[leaf * 4 + 2], &regs[leaf * 4 + 3]);
+    }
+    memcpy(name, regs, 48);
+
+    // The brand string is padded with spaces on the left on some Intel CPUs
+    char *start = name;
+    while (*start == ' ') start++;
+    memmove(name, start, strlen(start) + 1);
+    return name;
+}
+
+
+/* Folding with carry-less multiply, from the Intel paper "Fast CRC
+Computation for Generic Polynomials Using PCLMULQDQ Instruction" (Gopal et
+al., 2009). The constants are x^(4*128+32) mod P, x^(4*128-32) mod P, ... in
+the bit reflected domain, followed by the Barrett reduction constants for
+the 0xEDB88320 polynomial (the same values as lib/crc32-pclmul in Linux).
+   Four 128-bit accumulators fold 64 bytes per iteration, then they are
+folded together into one, then 16 bytes at a time, and the last 128 bits
+are reduced to the 32-bit CRC register.
+   crc32_pclmul_fold_from() continues from four accumulators already
+loaded with the first 64 bytes, so the AVX-512 kernel can hand its state
+over for the tail. len must be a multiple of 16, crc32_pclmul_update()
+takes care of the rest with the table engine. */
+
+__attribute__((target("pclmul,sse4.1")))
+static uint32_t crc32_pclmul_fold_from(__m128i acc[4], const uint8_t *buf, size_t len) {
+    static const uint64_t k1k2[2] = { 0x0154442bd4, 0x01c6e41596 };
+    static const uint64_t k3k4[2] = { 0x01751997d0, 0x00ccaa009e };
+    static const uint64_t k5k0[2] = { 0x0163cd6124, 0x0000000000 };
+    static const uint64_t poly[2] = { 0x01db710641, 0x01f7011641 };
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+    x1 = acc[0];
+    x2 = acc[1];
+    x3 = acc[2];
+    x4 = acc[3];
+
+    x0 = _mm_loadu_si128((const __m128i *)k1k2);
+
+    // Fold 64 bytes at a time
+    while (len >= 64) {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+        y5 = _mm_loadu_si128((const __m128i *)(buf + 0x00));
+        y6 = _mm_loadu_si128((const __m128i *)(buf + 0x10));
+        y7 = _mm_loadu_si128((const __m128i *)(buf + 0x20));
+        y8 = _mm_loadu_si128((const __m128i *)(buf + 0x30));
+
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+
+        buf += 64;
+        len -= 64;
+    }
+
+    // Fold the four accumulators into one
+    x0 = _mm_loadu_si128((const __m128i *)k3k4);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    // Fold 16 bytes at a time
+    while (len >= 16) {
+        x2 = _mm_loadu_si128((const __m128i *)buf);
+
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+        buf += 16;
+        len -= 16;
+    }
+
+    // Fold 128 bits to 64 bits
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+    x1 = _mm_srli_si128(x1, 8);
+    x1 = _mm_xor_si128(x1, x2);
+
+    x0 = _mm_loadl_epi64((const __m128i *)k5k0);
+
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, x3);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    // Barrett reduction to 32 bits
+    x0 = _mm_loadu_si128((const __m128i *)poly);
+
+    x2 = _mm_and_si128(x1, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+    x2 = _mm_and_si128(x2, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    return (uint32_t)_mm_extract_epi32(x1, 1);
+}
+
+
+// Needs len >= 64 and a multiple of 16
+__attribute__((target("pclmul,sse4.1")))
+static uint32_t crc32_pclmul_fold(uint32_t crc, const uint8_t *buf, size_t len) {
+    __m128i acc[4];
+
+    acc[0] = _mm_loadu_si128((const __m128i *)(buf + 0x00));
+    acc[1] = _mm_loadu_si128((const __m128i *)(buf + 0x10));
+    acc[2] = _mm_loadu_si128((const __m128i *)(buf + 0x20));
+    acc[3] = _mm_loadu_si128((const __m128i *)(buf + 0x30));
+    acc[0] = _mm_xor_si128(acc[0], _mm_cvtsi32_si128((int)crc));
+
+    return crc32_pclmul_fold_from(acc, buf + 64, len - 64);
+}
+
+
+/* Same folding with VPCLMULQDQ on 512-bit registers: four zmm accumulators
+hold 256 consecutive bytes (16 lanes of 128 bits) and each lane is folded
+over 2048 bits per iteration, constants x^(2048+32) and x^(2048-32) mod P.
+Then the four zmm are folded into one with the 4*128 constants, which
+leaves exactly the four 128-bit accumulators of crc32_pclmul_fold, and the
+rest (64/16 byte loops and the reduction) is shared with it.
+   Needs len >= 256 and a multiple of 16. */
+
+__attribute__((target("avx512f,vpclmulqdq,pclmul,sse4.1")))
+static uint32_t crc32_vpclmul_fold(uint32_t crc, const uint8_t *buf, size_t len) {
+    const __m512i k2048 = _mm512_broadcast_i32x4(_mm_set_epi32(0x00000001, 0x322d1430, 0x00000001, 0x1542778a));
+    const __m512i k512  = _mm512_broadcast_i32x4(_mm_set_epi32(0x00000001, 0xc6e41596, 0x00000001, 0x54442bd4));
+    __m512i z0, z1, z2, z3, t0, t1, t2, t3;
+    __m128i acc[4];
+
+    z0 = _mm512_loadu_si512((const void *)(buf + 0x00));
+    z1 = _mm512_loadu_si512((const void *)(buf + 0x40));
+    z2 = _mm512_loadu_si512((const void *)(buf + 0x80));
+    z3 = _mm512_loadu_si512((const void *)(buf + 0xC0));
+
+    z0 = _mm512_xor_si512(z0, _mm512_castsi128_si512(_mm_cvtsi32_si128((int)crc)));
+
+    buf += 256;
+    len -= 256;
+
+    // Fold 256 bytes at a time, 0x96 is the three input XOR for ternarylogic
+    while (len >= 256) {
+        t0 = _mm512_clmulepi64_epi128(z0, k2048, 0x00);
+        t1 = _mm512_clmulepi64_epi128(z1, k2048, 0x00);
+        t2 = _mm512_clmulepi64_epi128(z2, k2048, 0x00);
+        t3 = _mm512_clmulepi64_epi128(z3, k2048, 0x00);
+
+        z0 = _mm512_clmulepi64_epi128(z0, k2048, 0x11);
+        z1 = _mm512_clmulepi64_epi128(z1, k2048, 0x11);
+        z2 = _mm512_clmulepi64_epi128(z2, k2048, 0x11);
+        z3 = _mm512_clmulepi64_epi128(z3, k2048, 0x11);
+
+        z0 = _mm512_ternarylogic_epi64(z0, t0, _mm512_loadu_si512((const void *)(buf + 0x00)), 0x96);
+        z1 = _mm512_ternarylogic_epi64(z1, t1, _mm512_loadu_si512((const void *)(buf + 0x40)), 0x96);
+        z2 = _mm512_ternarylogic_epi64(z2, t2, _mm512_loadu_si512((const void *)(buf + 0x80)), 0x96);
+        z3 = _mm512_ternarylogic_epi64(z3, t3, _mm512_loadu_si512((const void *)(buf + 0xC0)), 0x96);
+
+        buf += 256;
+        len -= 256;
+    }
+
+    // Fold the four zmm accumulators into one
+    t0 = _mm512_clmulepi64_epi128(z0, k512, 0x00);
+    z0 = _mm512_clmulepi64_epi128(z0, k512, 0x11);
+    z1 = _mm512_ternarylogic_epi64(z1, z0, t0, 0x96);
+
+    t1 = _mm512_clmulepi64_epi128(z1, k512, 0x00);
+    z1 = _mm512_clmulepi64_epi128(z1, k512, 0x11);
+    z2 = _mm512_ternarylogic_epi64(z2, z1, t1, 0x96);
+
+    t2 = _mm512_clmulepi64_epi128(z2, k512, 0x00);
+    z2 = _mm512_clmulepi64_epi128(z2, k512, 0x11);
+    z3 = _mm512_ternarylogic_epi64(z3, z2, t2, 0x96);
+
+    acc[0] = _mm512_extracti32x4_epi32(z3, 0);
+    acc[1] = _mm512_extracti32x4_epi32(z3, 1);
+    acc[2] = _mm512_extracti32x4_epi32(z3, 2);
+    acc[3] = _mm512_extracti32x4_epi32(z3, 3);
+
+    _mm256_zeroupper();
+    return crc32_pclmul_fold_from(acc, buf, len);
+}
+
+
+uint32_t crc32_pclmul_update(uint32_t crc, const void *data, size_t len) {
+    const uint8_t *p = (const uint8_t *)data;
+
+    if (len >= 64 && (crc32_cpu_features() & CRC32_CPU_PCLMUL)) {
+        size_t blocks = len & ~(size_t)15;
+        crc = crc32_pclmul_fold(crc, p, blocks);
+        p += blocks;
+        len -= blocks;
+    }
+    return crc32_slice16_update(crc, p, len);
+}
+
+
+// Below the threshold the 128-bit kernel is as fast and does not pay for
+// the AVX-512 frequency switch (CRC32Bench prints the crossover point)
+static size_t crc32_wide_threshold = CRC32_WIDE_THRESHOLD;
+
+void crc32_set_wide_threshold(size_t bytes) {
+    crc32_wide_threshold = (bytes < 256) ? 256 : bytes;
+}
+
+
+uint32_t crc32_vpclmul_update(uint32_t crc, const void *data, size_t len) {
+    const uint8_t *p = (const uint8_t *)data;
+
+    if (len >= crc32_wide_threshold && (crc32_cpu_features() & CRC32_CPU_VPCLMUL)) {
+        size_t blocks = len & ~(size_t)15;
+        crc = crc32_vpclmul_fold(crc, p, blocks);
+        p += blocks;
+        len -= blocks;
+    }
+    return crc32_pclmul_update(crc, p, len);
+}
+
+
+
+/* CRC-32C with the SSE4.2 crc32 instruction. It has a latency of 3 cycles
+but the CPU can start one every cycle, so the buffer is cut in three equal
+parts whose CRCs are computed together in one loop. The CRC of the three
+parts is then put back together: the register of the first part is shifted
+over the length of the next part (multiplied by x^(8 len) mod P with the
+crc32c_shift tables) and XORed with the CRC of that part, which started
+from zero. This is the method of Mark Adler's crc32c.c, with 3 x 8 KB and
+3 x 256 byte blocks. */
+
+#ifdef __x86_64__
+typedef uint64_t crc32c_word;
+#define crc32c_hw_word(crc, p) ((uint32_t)_mm_crc32_u64((crc), crc32c_load_word(p)))
+#else
+typedef uint32_t crc32c_word;       // 32-bit build, no 64-bit crc32 instruction
+#define crc32c_hw_word(crc, p) _mm_crc32_u32((crc), crc32c_load_word(p))
+#endif
+
+static inline crc32c_word crc32c_load_word(const uint8_t *p) {
+    crc32c_word word;
+    memcpy(&word, p, sizeof(word));
+    return word;
+}
+
+
+static inline uint32_t crc32c_shift(const uint32_t table[4][256], uint32_t crc) {
+    return table[0][crc & 0xFF] ^ table[1][(crc >> 8) & 0xFF] ^
+           table[2][(crc >> 16) & 0xFF] ^ table[3][crc >> 24];
+}
+
+
+__attribute__((target("sse4.2")))
+uint32_t crc32c_sse42_update(uint32_t crc, const void *data, size_t len) {
+    const uint8_t *p = (const uint8_t *)data;
+    const uint8_t *end;
+    uint32_t crc1, crc2;
+
+    if (!(crc32_cpu_features() & CRC32_CPU_SSE42)) return crc32c_slice16_update(crc, data, len);
+
+    // Align the words, the loads below stay in one cache line
+    while (len > 0 && ((uintptr_t)p & (sizeof(crc32c_word) - 1)) != 0) {
+        crc = _mm_crc32_u8(crc, *p++);
+        len--;
+    }
+
+    while (len >= 3 * CRC32C_LONG) {
+        crc1 = 0;
+        crc2 = 0;
+        end = p + CRC32C_LONG;
+        do {
+            crc  = crc32c_hw_word(crc,  p);
+            crc1 = crc32c_hw_word(crc1, p + CRC32C_LONG);
+            crc2 = crc32c_hw_word(crc2, p + 2 * CRC32C_LONG);
+            p += sizeof(crc32c_word);
+        } while (p < end);
+        crc = crc32c_shift(crc32c_shift_long, crc) ^ crc1;
+        crc = crc32c_shift(crc32c_shift_long, crc) ^ crc2;
+        p += 2 * CRC32C_LONG;
+        len -= 3 * CRC32C_LONG;
+    }
+
+    while (len >= 3 * CRC32C_SHORT) {
+        crc1 = 0;
+        crc2 = 0;
+        end = p + CRC32C_SHORT;
+        do {
+            crc  = crc32c_hw_word(crc,  p);
+            crc1 = crc32c_hw_word(crc1, p + CRC32C_SHORT);
+            crc2 = crc32c_hw_word(crc2, p + 2 * CRC32C_SHORT);
+            p += sizeof(crc32c_word);
+        } while (p < end);
+        crc = crc32c_shift(crc32c_shift_short, crc) ^ crc1;
+        crc = crc32c_shift(crc32c_shift_short, crc) ^ crc2;
+        p += 2 * CRC32C_SHORT;
+        len -= 3 * CRC32C_SHORT;
+    }
+
+    // Less than 768 bytes left, one stream
+    while (len >= sizeof(crc32c_word)) {
+        crc = crc32c_hw_word(crc, p);
+        p += sizeof(crc32c_word);
+        len -= sizeof(crc32c_word);
+    }
+    while (len > 0) {
+        crc = _mm_crc32_u8(crc, *p++);
+        len--;
+    }
+    return crc;
+}
+
+#else // CRC32_HAVE_X86
+
+int crc32_cpu_features(void) {
+    return 0;
+}
+
+
+const char *crc32_cpu_name(void) {
+    return "unknown";
+}
+
+
+uint32_t crc32_pclmul_update(uint32_t crc, const void *data, size_t len) {
+    return crc32_slice16_update(crc, data, len);
+}
+
+
+void crc32_set_wide_threshold(size_t bytes) {
+    (void)bytes;
+}
+
+
+uint32_t crc32_vpclmul_update(uint32_t crc, const void *data, size_t len) {
+    return crc32_slice16_update(crc, data, len);
+}
+
+
+uint32_t crc32c_sse42_update(uint32_t crc, const void *data, size_t len) {
+    return crc32c_slice16_update(crc, data, len);
+}
+
+#endif // CRC32_HAVE_X86
@@ -0,0 +1,180 @@
+/*
+    Throughput of the CRC32 engines for growing buffer sizes.
+
+    Prints GB/s of the 128-bit PCLMULQDQ fold and of the AVX-512 VPCLMULQDQ
+    wide fold from 64 bytes to 64 MiB, and the buffer size from which the
+    wide fold stays faster. That size is what CRC32_WIDE_THRESHOLD should be
+    set to for this machine.
+
+    With --tiers it prints instead the bytes per cycle of the microcontroller
+    engines of CRC32_TIERS.c next to the size of their table, to choose the
+    one that fits the RAM/flash budget.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "CRC32.h"
+#include "CRC32_TIERS.h"
+
+#define MIN_SIZE   256           // Smallest input of the wide fold
+#define MAX_SIZE   (64u << 20)   // 64 MiB
+#define MIN_TIME   0.05          // Seconds spent on each measurement
+#define MARGIN     1.05          // Wide fold must be 5% faster to count, to ignore noise
+#define TIER_SIZE  (64u << 10)   // Input of the tier report, about the biggest file on the flash
+
+
+// Wall clock in seconds
+static double bench_now(void) {
+#ifdef _WIN32
+    LARGE_INTEGER freq, count;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    return (double)count.QuadPart / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
+
+// Repeat the CRC of size bytes until MIN_TIME is spent, return GB/s
+static double bench_engine(crc32_update_fn fn, const uint8_t *buffer, size_t size) {
+    volatile uint32_t sink = 0;
+    uint32_t rounds = 0;
+    double start, elapsed;
+
+    fn(CRC32_INIT, buffer, size);   // Warm up caches and the vector unit
+    start = bench_now();
+    do {
+        sink ^= fn(CRC32_INIT, buffer, size);
+        rounds++;
+        elapsed = bench_now() - start;
+    } while (elapsed < MIN_TIME);
+
+    (void)sink;
+    return (double)size * rounds / elapsed / 1e9;
+}
+
+
+// Time stamp counter, the cycles at the nominal clock of the CPU (0 when there is none)
+static uint64_t bench_cycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+
+// Bytes per cycle and GB/s of the microcontroller engines, checked against crc32b
+static int bench_tiers(void) {
+    uint8_t *buffer = (uint8_t *)malloc(TIER_SIZE);
+    int errors = 0;
+
+    if (buffer == NULL) {
+        perror("Memory allocation for the test buffer failed");
+        return 1;
+    }
+    for (size_t i = 0; i < TIER_SIZE; i++) {
+        buffer[i] = (uint8_t)(rand() >> 7);
+    }
+    uint32_t expected = crc32_bitwise_update(CRC32_INIT, buffer, TIER_SIZE);
+
+    printf("%-10s %12s %12s %8s\n", "Tier", "Table bytes", "Bytes/cycle", "GB/s");
+
+    for (int tier = 0; tier < CRC32_TIER_COUNT; tier++) {
+        const struct crc32_tier *t = &crc32_tiers[tier];
+        volatile uint32_t sink = 0;
+        uint32_t rounds = 0;
+        double start, elapsed;
+
+        int bad = t->update(CRC32_INIT, buffer, TIER_SIZE) != expected;
+        uint64_t cycles = bench_cycles();
+        start = bench_now();
+        do {
+            sink ^= t->update(CRC32_INIT, buffer, TIER_SIZE);
+            rounds++;
+            elapsed = bench_now() - start;
+        } while (elapsed < MIN_TIME);
+        cycles = bench_cycles() - cycles;
+        (void)sink;
+
+        double bytes = (double)TIER_SIZE * rounds;
+        if (cycles) {
+            printf("%-10s %12u %12.3f %8.2f%s\n", t->name, (unsigned)t->table_bytes,
+                   bytes / cycles, bytes / elapsed / 1e9, bad ? "  MISMATCH" : "");
+        } else {
+            printf("%-10s %12u %12s %8.2f%s\n", t->name, (unsigned)t->table_bytes,
+                   "-", bytes / elapsed / 1e9, bad ? "  MISMATCH" : "");
+        }
+        errors += bad;
+    }
+
+    printf("\nBuild the microcontroller code with -DCRC32_TIER=CRC32_TIER_<TABLELESS|NIBBLE|BYTE|SLICE4>\n");
+    free(buffer);
+    return errors != 0;
+}
+
+
+int main(int argc, char *argv[]) {
+    if (argc == 2 && strcmp(argv[1], "--tiers") == 0) {
+        return bench_tiers();
+    }
+
+    if (!(crc32_cpu_features() & CRC32_CPU_VPCLMUL)) {
+        printf("This CPU (or OS) has no AVX-512 VPCLMULQDQ, nothing to compare.\n");
+        return 0;
+    }
+
+    uint8_t *buffer = (uint8_t *)malloc(MAX_SIZE);
+    if (buffer == NULL) {
+        perror("Memory allocation for the test buffer failed");
+        return 1;
+    }
+    for (size_t i = 0; i < MAX_SIZE; i++) {
+        buffer[i] = (uint8_t)(rand() >> 7);
+    }
+
+    crc32_set_wide_threshold(0);        // Always take the wide path, to see where it pays off
+
+    printf("%12s %12s %12s %8s\n", "Size", "pclmul GB/s", "vpclmul GB/s", "Ratio");
+
+    size_t crossover = 0;
+    for (size_t size = MIN_SIZE; size <= MAX_SIZE; size *= 2) {
+        double narrow = bench_engine(crc32_pclmul_update, buffer, size);
+        double wide = bench_engine(crc32_vpclmul_update, buffer, size);
+
+        printf("%12u %12.2f %12.2f %8.2f\n", (unsigned)size, narrow, wide, wide / narrow);
+
+        // Remember the first size of the run where the wide fold keeps winning
+        if (wide > narrow * MARGIN) {
+            if (crossover == 0) crossover = size;
+        } else {
+            crossover = 0;
+        }
+    }
+
+    if (crossover) {
+        printf("\nThe wide fold is faster from %u bytes, build with -DCRC32_WIDE_THRESHOLD=%u\n",
+               (unsigned)crossover, (unsigned)crossover);
+    } else {
+        printf("\nThe wide fold never stays faster on this machine\n");
+    }
+
+    free(buffer);
+    return 0;
+}
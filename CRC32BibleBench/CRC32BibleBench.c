@@ -0,0 +1,434 @@
+/*
+    Throughput of every CRC-32 routine in the repository.
+
+    Times crc32a ... crc32h of CRC32_BIBLE.c and the engines of CRC32/CRC32.c
+    on random messages from 16 bytes to 64 MiB at several buffer alignments,
+    with the cache warm (same buffer again and again) and cold (cache flushed
+    before each call, so the data and the lookup tables come from memory),
+    and on the files of DISK_CONTENT2 (or the files dropped on the exe).
+
+    Reports ns/byte, GB/s and cycles/byte. The cycles come from the CPU cycle
+    counter through perf_event_open on Linux, where the kernel allows it
+    (kernel.perf_event_paranoid), and are left out elsewhere.
+
+        CRC32BibleBench [--csv] [--max=BYTES] [--baseline=FILE] [--threshold=PCT] [files...]
+
+    --csv prints the results as CSV, save it to use as a baseline later:
+        CRC32BibleBench --csv > baseline.csv
+        CRC32BibleBench --baseline=baseline.csv --threshold=10
+    With --baseline the exit code is 1 when a measurement is more than PCT
+    percent (10 by default) slower than in the baseline, or when a routine
+    gives a wrong CRC.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "CRC32.h"
+
+#define MIN_SIZE     16             // Message sizes, x4 each step
+#define MAX_SIZE     (64u << 20)    // 64 MiB
+#define MIN_TIME     0.02           // Seconds spent on each warm measurement
+#define COLD_ROUNDS  5              // Calls averaged for a cold measurement
+#define COLD_MAX     (1u << 20)     // Bigger messages do not fit in the cache anyway
+#define EVICT_SIZE   (32u << 20)    // Written before a cold call, more than the last level cache
+#define MAX_BASELINE 4096
+
+// The routines of CRC32_BIBLE.c, built with -DCRC32_BIBLE_NO_MAIN
+unsigned int crc32a(unsigned char *message);
+unsigned int crc32b(unsigned char *message);
+unsigned int crc32c(unsigned char *message);
+unsigned int crc32cx(unsigned char *message);
+unsigned int crc32d(unsigned char *message);
+unsigned int crc32e(unsigned char *message);
+unsigned int crc32f(unsigned char *message);
+unsigned int crc32g(unsigned char *message);
+unsigned int crc32h(unsigned char *message);
+
+// The Hacker's Delight routines work on 0 terminated messages, the engines on a length
+struct VARIANT {
+    const char *name;
+    unsigned int (*bible)(unsigned char *message);
+    crc32_update_fn update;
+    int cpu;                    // CRC32_CPU_* features needed, 0 for none
+    int words;                  // Only for messages of whole 32-bit words (crc32cx)
+    int castagnoli;             // CRC-32C, not comparable with crc32b
+};
+
+static const struct VARIANT variants[] = {
+    { "crc32a",         crc32a,  NULL,                   0,                 0, 0 },
+    { "crc32b",         crc32b,  NULL,                   0,                 0, 0 },
+    { "crc32c",         crc32c,  NULL,                   0,                 0, 0 },
+    { "crc32cx",        crc32cx, NULL,                   0,                 1, 0 },
+    { "crc32d",         crc32d,  NULL,                   0,                 0, 0 },
+    { "crc32e",         crc32e,  NULL,                   0,                 0, 0 },
+    { "crc32f",         crc32f,  NULL,                   0,                 0, 0 },
+    { "crc32g",         crc32g,  NULL,                   0,                 0, 0 },
+    { "crc32h",         crc32h,  NULL,                   0,                 0, 0 },
+    { "bitwise",        NULL,    crc32_bitwise_update,   0,                 0, 0 },
+    { "slice8",         NULL,    crc32_slice8_update,    0,                 0, 0 },
+    { "slice16",        NULL,    crc32_slice16_update,   0,                 0, 0 },
+    { "pclmul",         NULL,    crc32_pclmul_update,    CRC32_CPU_PCLMUL,  0, 0 },
+    { "vpclmul",        NULL,    crc32_vpclmul_update,   CRC32_CPU_VPCLMUL, 0, 0 },
+    { "table",          NULL,    crc32_table_update,     0,                 0, 0 },
+    { "halfword",       NULL,    crc32_halfword_update,  0,                 0, 0 },
+    { "crc32c-slice16", NULL,    crc32c_slice16_update,  0,                 0, 1 },
+    { "crc32c-sse42",   NULL,    crc32c_sse42_update,    CRC32_CPU_SSE42,   0, 1 }
+};
+
+#define VARIANT_COUNT (int)(sizeof(variants) / sizeof(variants[0]))
+
+static const int alignments[] = { 0, 1, 4 };
+
+#define ALIGNMENT_COUNT (int)(sizeof(alignments) / sizeof(alignments[0]))
+
+// Inputs used when no file is given on the command line
+static const char *default_files[] = {
+    "../DISK_CONTENT2/WSCLI.HTM",
+    "../DISK_CONTENT2/WSCLIC1.HTM",
+    "../DISK_CONTENT2/1023.txt",
+    "../DISK_CONTENT2/100KiB.txt",
+    "../DISK_CONTENT2/1MiB.txt",
+    NULL
+};
+
+struct RESULT {
+    double ns_per_byte;
+    double gb_per_s;
+    double cycles_per_byte;     // Negative when there is no cycle counter
+};
+
+struct BASELINE {
+    char key[128];              // variant,input,size,align,cache
+    double gb_per_s;
+};
+
+static struct BASELINE *baseline;
+static int baseline_count;
+static double threshold = 10.0;
+static int csv;
+
+static uint8_t *evict_buffer;
+static int cycles_fd = -1;
+
+
+// Wall clock in seconds
+static double bench_now(void) {
+#ifdef _WIN32
+    LARGE_INTEGER freq, count;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    return (double)count.QuadPart / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
+
+// User mode CPU cycles of this thread, cycles_fd stays -1 if the kernel says no
+static void cycles_open(void) {
+#ifdef __linux__
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CPU_CYCLES;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    cycles_fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+}
+
+
+static uint64_t cycles_read(void) {
+    uint64_t count = 0;
+#ifdef __linux__
+    if (cycles_fd >= 0 && read(cycles_fd, &count, sizeof(count)) != sizeof(count)) count = 0;
+#endif
+    return count;
+}
+
+
+// Write a buffer bigger than the caches, so the next call starts cold
+static void evict_caches(void) {
+    for (size_t i = 0; i < EVICT_SIZE; i += 64) {
+        evict_buffer[i]++;
+    }
+}
+
+
+static uint32_t run_variant(const struct VARIANT *v, uint8_t *message, size_t size) {
+    if (v->bible) return v->bible(message);
+    return crc32_final(v->update(CRC32_INIT, message, size));
+}
+
+
+// Time one variant on size bytes at message, which has 4 zero bytes after it
+static struct RESULT measure(const struct VARIANT *v, uint8_t *message, size_t size, int cold) {
+    volatile uint32_t sink = 0;
+    struct RESULT result;
+    uint64_t cycles = 0, start_cycles;
+    uint32_t rounds = 0, batch;
+    double elapsed = 0, start;
+
+    sink ^= run_variant(v, message, size);     // Sets up the tables of crc32c, crc32d, ...
+
+    if (cold) {
+        // One call per flush, on short messages this is mostly the latency of the clock
+        for (rounds = 0; rounds < COLD_ROUNDS; rounds++) {
+            evict_caches();
+            start_cycles = cycles_read();
+            start = bench_now();
+            sink ^= run_variant(v, message, size);
+            elapsed += bench_now() - start;
+            cycles += cycles_read() - start_cycles;
+        }
+    } else {
+        // Read the clock about every 64 KB, so its cost does not count on short messages
+        batch = (size < 65536) ? (uint32_t)(65536 / size) : 1;
+        start_cycles = cycles_read();
+        start = bench_now();
+        do {
+            for (uint32_t i = 0; i < batch; i++) {
+                sink ^= run_variant(v, message, size);
+            }
+            rounds += batch;
+            elapsed = bench_now() - start;
+        } while (elapsed < MIN_TIME);
+        cycles = cycles_read() - start_cycles;
+    }
+
+    (void)sink;
+    result.ns_per_byte = elapsed * 1e9 / ((double)size * rounds);
+    result.gb_per_s = (double)size * rounds / elapsed / 1e9;
+    result.cycles_per_byte = (cycles_fd >= 0) ? (double)cycles / ((double)size * rounds) : -1.0;
+    return result;
+}
+
+
+static int load_baseline(const char *filename) {
+    char line[256], variant[32], input[64], cache[8];
+    unsigned size, align;
+    double ns, gbps;
+
+    FILE *file = fopen(filename, "r");
+    if (!file) {
+        perror("Error opening the baseline file");
+        return -1;
+    }
+
+    baseline = (struct BASELINE *)calloc(MAX_BASELINE, sizeof(struct BASELINE));
+    if (baseline == NULL) {
+        fclose(file);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), file) && baseline_count < MAX_BASELINE) {
+        if (sscanf(line, "%31[^,],%63[^,],%u,%u,%7[^,],%lf,%lf", variant, input, &size, &align,
+                   cache, &ns, &gbps) != 7) {
+            continue;               // Header line
+        }
+        snprintf(baseline[baseline_count].key, sizeof(baseline[0].key), "%s,%s,%u,%u,%s",
+                 variant, input, size, align, cache);
+        baseline[baseline_count].gb_per_s = gbps;
+        baseline_count++;
+    }
+
+    fclose(file);
+    return 0;
+}
+
+
+// Print one measurement and compare it with the baseline, return 1 on a regression
+static int report(const char *variant, const char *input, size_t size, int align, int cold,
+                  struct RESULT r) {
+    char key[128];
+    const char *cache = cold ? "cold" : "warm";
+
+    if (csv) {
+        printf("%s,%s,%u,%d,%s,%.4f,%.4f,", variant, input, (unsigned)size, align, cache,
+               r.ns_per_byte, r.gb_per_s);
+        if (r.cycles_per_byte >= 0) printf("%.4f\n", r.cycles_per_byte);
+        else printf("\n");
+    } else {
+        printf("%-15s %-12s %10u %5d %5s %10.4f %9.3f", variant, input, (unsigned)size, align,
+               cache, r.ns_per_byte, r.gb_per_s);
+        if (r.cycles_per_byte >= 0) printf(" %9.3f\n", r.cycles_per_byte);
+        else printf(" %9s\n", "-");
+    }
+
+    snprintf(key, sizeof(key), "%s,%s,%u,%d,%s", variant, input, (unsigned)size, align, cache);
+    for (int i = 0; i < baseline_count; i++) {
+        if (strcmp(key, baseline[i].key) != 0) continue;
+        if (r.gb_per_s < baseline[i].gb_per_s * (1.0 - threshold / 100.0)) {
+            fprintf(stderr, "REGRESSION %s: %.3f GB/s, baseline %.3f GB/s\n",
+                    key, r.gb_per_s, baseline[i].gb_per_s);
+            return 1;
+        }
+        break;
+    }
+    return 0;
+}
+
+
+// Run every variant on one message, return the number of wrong CRCs and regressions
+static int bench_message(const char *input, uint8_t *message, size_t size, int align, int cold) {
+    uint8_t saved[4];
+    int errors = 0;
+
+    // 0 terminator for crc32a ... crc32h (crc32cx reads it as a whole word)
+    memcpy(saved, message + size, 4);
+    memset(message + size, 0, 4);
+
+    uint32_t ieee = crc32_final(crc32_slice16_update(CRC32_INIT, message, size));
+    uint32_t castagnoli = crc32_final(crc32c_slice16_update(CRC32_INIT, message, size));
+
+    for (int i = 0; i < VARIANT_COUNT; i++) {
+        const struct VARIANT *v = &variants[i];
+
+        if (v->cpu && !(crc32_cpu_features() & v->cpu)) continue;
+        if (v->words && (size & 3)) continue;
+
+        if (run_variant(v, message, size) != (v->castagnoli ? castagnoli : ieee)) {
+            fprintf(stderr, "MISMATCH %s on %s, %u bytes, align %d\n", v->name, input,
+                    (unsigned)size, align);
+            errors++;
+            continue;
+        }
+        errors += report(v->name, input, size, align, cold, measure(v, message, size, cold));
+    }
+
+    memcpy(message + size, saved, 4);
+    return errors;
+}
+
+
+// Read a whole file with room for the terminator, 0 bytes are made spaces
+// because crc32a ... crc32h stop at the first one
+static uint8_t *load_input(const char *filename, size_t *size) {
+    FILE *file = fopen(filename, "rb");
+    if (!file) return NULL;
+
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    rewind(file);
+
+    uint8_t *buffer = (length >= 0) ? (uint8_t *)malloc((size_t)length + 4) : NULL;
+    if (buffer == NULL || fread(buffer, 1, (size_t)length, file) != (size_t)length) {
+        free(buffer);
+        fclose(file);
+        return NULL;
+    }
+    fclose(file);
+
+    for (long i = 0; i < length; i++) {
+        if (buffer[i] == 0) buffer[i] = ' ';
+    }
+    *size = (size_t)length;
+    return buffer;
+}
+
+
+int main(int argc, char *argv[]) {
+    const char *files[64];
+    int file_count = 0;
+    size_t max_size = MAX_SIZE;
+    int errors = 0;
+
+    // Command line options, see the comment at the top
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--csv") == 0) {
+            csv = 1;
+        } else if (strncmp(argv[i], "--max=", 6) == 0) {
+            max_size = strtoul(argv[i] + 6, NULL, 0);
+            if (max_size < MIN_SIZE || max_size > MAX_SIZE) max_size = MAX_SIZE;
+        } else if (strncmp(argv[i], "--baseline=", 11) == 0) {
+            if (load_baseline(argv[i] + 11) != 0) return 1;
+        } else if (strncmp(argv[i], "--threshold=", 12) == 0) {
+            threshold = atof(argv[i] + 12);
+        } else if (file_count < 64) {
+            files[file_count++] = argv[i];
+        }
+    }
+    if (file_count == 0) {
+        for (int i = 0; default_files[i] != NULL; i++) files[file_count++] = default_files[i];
+    }
+
+    // Random bytes, without 0 for the terminated routines, and room for the alignments
+    uint8_t *buffer = (uint8_t *)malloc(max_size + 128);
+    evict_buffer = (uint8_t *)calloc(EVICT_SIZE, 1);
+    if (buffer == NULL || evict_buffer == NULL) {
+        perror("Memory allocation for the test buffers failed");
+        return 1;
+    }
+    for (size_t i = 0; i < max_size + 128; i++) {
+        buffer[i] = (uint8_t)(1 + rand() % 255);
+    }
+    uint8_t *aligned = buffer + ((64 - ((uintptr_t)buffer & 63)) & 63);   // 64 byte aligned, 60+ bytes spare
+
+    cycles_open();
+    crc32_select_engine(CRC32_ENGINE_HALFWORD);     // Builds the table of crc32_halfword_update
+
+    if (csv) {
+        printf("variant,input,size,align,cache,ns_per_byte,gb_per_s,cycles_per_byte\n");
+    } else {
+        printf("%-15s %-12s %10s %5s %5s %10s %9s %9s\n", "Variant", "Input", "Size", "Align",
+               "Cache", "ns/byte", "GB/s", "cyc/byte");
+    }
+
+    for (size_t size = MIN_SIZE; size <= max_size; size *= 4) {
+        for (int a = 0; a < ALIGNMENT_COUNT; a++) {
+            errors += bench_message("random", aligned + alignments[a], size, alignments[a], 0);
+            if (size <= COLD_MAX) {
+                errors += bench_message("random", aligned + alignments[a], size, alignments[a], 1);
+            }
+        }
+    }
+
+    for (int f = 0; f < file_count; f++) {
+        size_t size;
+        uint8_t *data = load_input(files[f], &size);
+        if (data == NULL) {
+            fprintf(stderr, "Skipping %s, can not read it\n", files[f]);
+            continue;
+        }
+
+        // Name without the folder, as the input column
+        const char *name = files[f] + strlen(files[f]);
+        while (name > files[f] && name[-1] != '/' && name[-1] != '\\') name--;
+
+        errors += bench_message(name, data, size, 0, 0);
+        if (size <= COLD_MAX) errors += bench_message(name, data, size, 0, 1);
+        free(data);
+    }
+
+    if (cycles_fd < 0) {
+        fprintf(stderr, "No CPU cycle counter (perf_event_open not allowed or not Linux), cycles/byte left out\n");
+    }
+    if (baseline_count > 0) {
+        fprintf(stderr, "%s against the baseline (threshold %.1f%%)\n",
+                errors ? "FAILED" : "OK", threshold);
+    }
+
+    free(evict_buffer);
+    free(buffer);
+    free(baseline);
+    return errors != 0;
+}
@@ -0,0 +1,193 @@
+#define _FILE_OFFSET_BITS 64    // Sizes past 2 GB on 32-bit POSIX hosts
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "CRC32.h"
+#include "FILECRC.h"
+#include "APPEND.h"
+
+/* The sidecar is one text line:
+     <model> <size> <mtime> <register> <sample CRC>
+   register is the CRC of the first size bytes before crc32_model_finish, so
+   the appended bytes are fed to crc32_model_update from there. sample CRC is
+   the CRC of APPEND_SAMPLE bytes at the start, the middle and the end of those
+   size bytes: an append does not change it, an edit of the saved part most
+   likely does. */
+
+struct APPEND_STATE {
+    char model[32];
+    uint64_t size;
+    long long mtime;
+    uint32_t crc;                   // Register, not finished
+    uint32_t sample;
+};
+
+
+// The file, mapped when it is big enough (see FILECRC_MMAP_MIN)
+struct APPEND_FILE {
+    FILE *file;
+    const uint8_t *map;
+    uint64_t size;
+};
+
+
+static int append_read(struct APPEND_FILE *file, uint64_t offset, void *data, size_t len) {
+    if (file->map) {
+        memcpy(data, file->map + offset, len);
+        return 0;
+    }
+    return filecrc_read_at(file->file, offset, data, len);
+}
+
+
+// Register after the bytes from start to end
+static int append_update(const struct crc32_model *model, struct APPEND_FILE *file,
+                         uint64_t start, uint64_t end, uint32_t *crc) {
+    if (file->map) {
+        *crc = crc32_model_update(model, *crc, file->map + start, (size_t)(end - start));
+        return 0;
+    }
+
+    uint8_t *buffer = (uint8_t *)malloc(FILECRC_READ_SIZE);
+    if (buffer == NULL) return -1;
+    while (start < end) {
+        size_t want = (end - start < FILECRC_READ_SIZE) ? (size_t)(end - start) : FILECRC_READ_SIZE;
+        if (append_read(file, start, buffer, want) != 0) {
+            free(buffer);
+            return -1;
+        }
+        *crc = crc32_model_update(model, *crc, buffer, want);
+        start += want;
+    }
+    free(buffer);
+    return 0;
+}
+
+
+// CRC of the 3 samples of the first size bytes
+static int append_sample(const struct crc32_model *model, struct APPEND_FILE *file,
+                         uint64_t size, uint32_t *sample) {
+    uint8_t buffer[APPEND_SAMPLE];
+    uint64_t at[3];
+    size_t len = (size < APPEND_SAMPLE) ? (size_t)size : APPEND_SAMPLE;
+    uint32_t crc = crc32_model_start(model);
+
+    at[0] = 0;
+    at[1] = (size - len) / 2;
+    at[2] = size - len;
+    for (int i = 0; i < 3 && len > 0; i++) {
+        if (append_read(file, at[i], buffer, len) != 0) return -1;
+        crc = crc32_model_update(model, crc, buffer, len);
+    }
+    *sample = crc32_model_finish(model, crc);
+    return 0;
+}
+
+
+static int append_load(const char *path, struct APPEND_STATE *state) {
+    FILE *file = fopen(path, "r");
+    unsigned long long size;
+    unsigned int crc, sample;
+    int fields;
+
+    if (file == NULL) return -1;
+    fields = fscanf(file, "%31s %llu %lld %x %x", state->model, &size, &state->mtime, &crc, &sample);
+    fclose(file);
+    if (fields != 5) return -1;
+
+    state->size = size;
+    state->crc = crc;
+    state->sample = sample;
+    return 0;
+}
+
+
+static int append_save(const char *path, const struct APPEND_STATE *state) {
+    FILE *file = fopen(path, "w");
+
+    if (file == NULL) return -1;
+    fprintf(file, "%s %llu %lld %08X %08X\n", state->model, (unsigned long long)state->size,
+            state->mtime, state->crc, state->sample);
+    return (fclose(file) == 0) ? 0 : -1;
+}
+
+
+int append_crc(const struct crc32_model *model, const char *filename, uint32_t *crc, uint64_t *new_bytes) {
+    struct APPEND_STATE state;
+    struct APPEND_FILE file;
+    struct stat info;
+    int result = APPEND_FULL;
+
+    size_t path_len = strlen(filename) + sizeof(APPEND_SUFFIX);
+    char *path = (char *)malloc(path_len);
+    if (path == NULL) {
+        perror("Memory allocation for the state file name failed");
+        return -1;
+    }
+    snprintf(path, path_len, "%s" APPEND_SUFFIX, filename);
+
+    memset(&file, 0, sizeof(file));
+    file.file = fopen(filename, "rb");
+    if (file.file == NULL || stat(filename, &info) != 0) {
+        perror(filename);
+        if (file.file) fclose(file.file);
+        free(path);
+        return -1;
+    }
+    int64_t size = filecrc_size(file.file);
+    if (size < 0) {
+        perror(filename);
+        fclose(file.file);
+        free(path);
+        return -1;
+    }
+    file.size = (uint64_t)size;
+    if (file.size >= FILECRC_MMAP_MIN) file.map = filecrc_map(file.file, file.size);
+
+    // Start again from the saved register if the saved part is still there
+    uint64_t start = 0;
+    uint32_t reg = crc32_model_start(model);
+    if (append_load(path, &state) == 0 && strcmp(state.model, model->name) == 0 &&
+        state.size <= file.size) {
+        uint32_t sample;
+        if (state.size == file.size && state.mtime == (long long)info.st_mtime) {
+            result = APPEND_UNCHANGED;
+            start = state.size;
+            reg = state.crc;
+        } else if (append_sample(model, &file, state.size, &sample) == 0 && sample == state.sample) {
+            result = APPEND_APPENDED;
+            start = state.size;
+            reg = state.crc;
+        }
+    }
+
+    if (append_update(model, &file, start, file.size, &reg) != 0) {
+        fprintf(stderr, "%s: read error\n", filename);
+        result = -1;
+    }
+
+    if (result != -1 && result != APPEND_UNCHANGED) {
+        memset(&state, 0, sizeof(state));
+        snprintf(state.model, sizeof(state.model), "%s", model->name);
+        state.size = file.size;
+        state.mtime = (long long)info.st_mtime;
+        state.crc = reg;
+        if (append_sample(model, &file, file.size, &state.sample) != 0 || append_save(path, &state) != 0) {
+            perror(path);       // The CRC is still right, the next run reads everything
+        }
+    }
+
+    filecrc_unmap(file.map, file.size);
+    fclose(file.file);
+    free(path);
+
+    *crc = crc32_model_finish(model, reg);
+    *new_bytes = file.size - start;
+    return result;
+}
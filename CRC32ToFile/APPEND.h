@@ -0,0 +1,27 @@
+#ifndef __APPEND_H__
+#define __APPEND_H__
+
+#include <stdint.h>
+
+#include "CRC32.h"
+
+// Incremental CRC of files that only grow (logs staged for the 25Q32 flash).
+// The running CRC register is saved with the length and the date of the file
+// in a sidecar next to it (<filename>.crcstate); the next run only CRCs the
+// bytes appended since and gives the same CRC as reading the whole file.
+// If the file shrank or its saved part was changed (found by CRCing a few
+// samples of it) the whole file is CRCed again.
+
+#define APPEND_SUFFIX ".crcstate"
+#define APPEND_SAMPLE 4096          // Bytes of each of the 3 samples (start, middle, end)
+
+// How append_crc() got the CRC
+#define APPEND_UNCHANGED  0         // Same size and date, nothing was read
+#define APPEND_APPENDED   1         // Only the new bytes were CRCed
+#define APPEND_FULL       2         // No usable state, the whole file was CRCed
+
+// CRC (of the given model) of filename, the sidecar is updated.
+// Return one of APPEND_..., -1 on error. new_bytes gets the bytes CRCed.
+int append_crc(const struct crc32_model *model, const char *filename, uint32_t *crc, uint64_t *new_bytes);
+
+#endif // APPEND_H
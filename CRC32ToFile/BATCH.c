@@ -0,0 +1,527 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <ctype.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+
+#include "CRC32.h"
+#include "FILECRC.h"
+#include "THREADS.h"
+#include "BATCH.h"
+#include "URING.h"
+
+#define BENCH_RUNS 3                // batch_bench keeps the best of this many passes
+
+
+int batch_is_directory(const char *path) {
+    struct stat info;
+    return stat(path, &info) == 0 && S_ISDIR(info.st_mode);
+}
+
+
+static int batch_add_file(struct BATCH_LIST *list, const char *path, uint64_t size) {
+    if (list->count == list->capacity) {
+        int capacity = list->capacity ? list->capacity * 2 : 256;
+        struct BATCH_FILE *files = (struct BATCH_FILE *)realloc(list->files, capacity * sizeof(struct BATCH_FILE));
+        if (files == NULL) return -1;
+        list->files = files;
+        list->capacity = capacity;
+    }
+
+    struct BATCH_FILE *file = &list->files[list->count];
+    memset(file, 0, sizeof(*file));
+    file->path = strdup(path);
+    if (file->path == NULL) return -1;
+    file->listed_size = size;
+    list->count++;
+    return 0;
+}
+
+
+// Files of path, directories walked recursively in readdir order. Links to
+// directories are not followed on POSIX, so a loop can not make the walk endless.
+static int batch_add_path(struct BATCH_LIST *list, const char *path) {
+    struct stat info;
+
+#ifdef _WIN32
+    if (stat(path, &info) != 0) {
+#else
+    if (lstat(path, &info) != 0) {
+#endif
+        perror(path);
+        return -1;
+    }
+    if (!S_ISDIR(info.st_mode)) {
+        return S_ISREG(info.st_mode) ? batch_add_file(list, path, (uint64_t)info.st_size) : 0;
+    }
+
+    DIR *dir = opendir(path);
+    if (dir == NULL) {
+        perror(path);
+        return -1;
+    }
+
+    int result = 0;
+    struct dirent *entry;
+    while (result == 0 && (entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+
+        size_t length = strlen(path) + strlen(entry->d_name) + 2;
+        char *child = (char *)malloc(length);
+        if (child == NULL) {
+            result = -1;
+            break;
+        }
+        snprintf(child, length, "%s/%s", path, entry->d_name);
+        result = batch_add_path(list, child);
+        free(child);
+    }
+    closedir(dir);
+    return result;
+}
+
+
+void batch_split_trailer(struct BATCH_FILE *file, const uint8_t *end, uint64_t size) {
+    file->tail_len = (size < 8) ? (int)size : 8;
+    memcpy(file->tail, end - file->tail_len, file->tail_len);
+    file->size = size - file->tail_len;
+}
+
+
+void batch_check(struct BATCH_FILE *file) {
+    const struct crc32_model *model = file->model;
+    char digits[9];
+
+    if (file->error) return;
+
+    // Binary trailer: the CRC carried on over the last bytes is the residue.
+    // file->crc is finished, undo the final XOR (refin equals refout here).
+    uint32_t whole = crc32_model_update(model, file->crc ^ model->xorout, file->tail, file->tail_len);
+    if (crc32_model_finish(model, whole) == crc32_model_residue(model)) {
+        file->verdict = BATCH_OK;
+        file->binary = 1;
+        return;
+    }
+
+    // Text trailer: 8 hex digits, the CRC of the data before them
+    if (file->tail_len < 8) {
+        file->verdict = BATCH_NO_TRAILER;
+        return;
+    }
+    memcpy(digits, file->tail, 8);
+    digits[8] = 0;
+    for (int i = 0; i < 8; i++) {
+        if (!isxdigit((unsigned char)digits[i])) {
+            file->verdict = BATCH_NO_TRAILER;
+            return;
+        }
+    }
+    file->trailer = (uint32_t)strtoul(digits, NULL, 16);
+    file->verdict = (file->crc == file->trailer) ? BATCH_OK : BATCH_MISMATCH;
+}
+
+
+// Same trailer as the single file mode, at the end of the data that was CRCed
+// (with --verify the trailer that is there is checked instead)
+static void batch_finish(struct BATCH_FILE *file) {
+    char crc_hex[9];
+
+    filecrc_unmap(file->map, file->map_size);
+    file->map = NULL;
+
+    if (file->flags & BATCH_VERIFY) {
+        batch_check(file);
+    } else if (!file->error && !(file->flags & BATCH_NO_WRITE)) {
+        int len = 8;
+        if (file->flags & BATCH_BINARY) {
+            crc32_model_store(file->model, file->crc, (uint8_t *)crc_hex);
+            len = 4;
+        } else {
+            snprintf(crc_hex, sizeof(crc_hex), "%08X", file->crc);
+        }
+        if (filecrc_write_at(file->file, file->size, crc_hex, len) != 0) {
+            perror(file->path);
+            file->error = 1;
+        }
+    }
+    fclose(file->file);
+    file->file = NULL;
+}
+
+
+static void batch_range(struct BATCH_FILE *file, uint32_t range) {
+    uint64_t start = (uint64_t)range * file->range_size;
+    uint64_t length = file->size - start;
+    if (length > file->range_size) length = file->range_size;
+
+    if (!file->range_error &&
+        filecrc_range(file->model, file->path, file->map, start, length, &file->range_crc[range]) != 0) {
+        file->range_error = 1;
+    }
+
+    if (threads_fetch_add(&file->ranges_left, -1) == 1) {
+        if (file->range_error) {
+            file->error = 1;
+        } else {
+            file->crc = filecrc_merge(file->model, file->range_crc, file->size, file->range_size);
+        }
+        free(file->range_crc);
+        free(file->ranges);
+        file->range_crc = NULL;
+        file->ranges = NULL;
+        batch_finish(file);
+    }
+}
+
+
+// Whole file task: small files are done here, big ones are split and the
+// ranges are queued on this worker's deque for the idle workers to steal
+static void batch_file(struct THREAD_POOL *pool, int worker, struct BATCH_FILE *file) {
+    file->file = fopen(file->path, (file->flags & BATCH_NO_WRITE) ? "rb" : "r+b");
+    if (file->file == NULL) {
+        perror(file->path);
+        file->error = 1;
+        return;
+    }
+
+    int64_t size = filecrc_size(file->file);
+    if (size < 0) {
+        perror(file->path);
+        file->error = 1;
+        fclose(file->file);
+        file->file = NULL;
+        return;
+    }
+    file->size = (uint64_t)size;
+    if (file->size >= FILECRC_MMAP_MIN) {
+        file->map = filecrc_map(file->file, file->size);
+        file->map_size = file->size;
+    }
+
+    // --verify: the last 8 bytes are kept aside, the trailer is text or binary
+    if (file->flags & BATCH_VERIFY) {
+        uint8_t end[8];
+        uint64_t tail = (file->size < 8) ? file->size : 8;
+        if (file->map) {
+            memcpy(end + 8 - tail, file->map + file->size - tail, (size_t)tail);
+        } else if (filecrc_read_at(file->file, file->size - tail, end + 8 - tail, (size_t)tail) != 0) {
+            perror(file->path);
+            file->error = 1;
+            batch_finish(file);
+            return;
+        }
+        batch_split_trailer(file, end + 8, file->size);
+    }
+
+    if (threads_pool_count(pool) > 1 && file->size >= FILECRC_PARALLEL_MIN) {
+        file->range_size = filecrc_range_size(file->size, threads_pool_count(pool));
+        file->range_count = (uint32_t)((file->size + file->range_size - 1) / file->range_size);
+        file->range_crc = (uint32_t *)calloc(file->range_count, sizeof(uint32_t));
+        file->ranges = (struct BATCH_TASK *)calloc(file->range_count, sizeof(struct BATCH_TASK));
+        if (file->range_crc && file->ranges) {
+            file->ranges_left = file->range_count;
+
+            // Last range pushed first, so this worker pops them in file order
+            // while the thieves take them from the end
+            uint32_t r;
+            for (r = file->range_count - 1; r >= 1; r--) {
+                file->ranges[r].file = file;
+                file->ranges[r].range = (int32_t)r;
+                if (threads_pool_push(pool, worker, &file->ranges[r]) != 0) break;
+            }
+            // Ranges that could not be queued are done here
+            for (; r >= 1; r--) batch_range(file, r);
+            batch_range(file, 0);
+            return;
+        }
+        free(file->range_crc);
+        free(file->ranges);
+        file->range_crc = NULL;
+        file->ranges = NULL;
+    }
+
+    // Not split (small file, one worker, or no memory for the ranges)
+    if (file->map) {
+        file->crc = crc32_model_compute(file->model, file->map, (size_t)file->size);
+    } else {
+        unsigned char buffer[4096];
+        uint64_t remaining = file->size;
+        uint32_t crc = crc32_model_start(file->model);
+        while (remaining > 0) {
+            size_t want = (remaining < sizeof(buffer)) ? (size_t)remaining : sizeof(buffer);
+            if (fread(buffer, 1, want, file->file) != want) {
+                fprintf(stderr, "%s: short read\n", file->path);
+                file->error = 1;
+                break;
+            }
+            crc = crc32_model_update(file->model, crc, buffer, want);
+            remaining -= want;
+        }
+        file->crc = crc32_model_finish(file->model, crc);
+    }
+    batch_finish(file);
+}
+
+
+// The small files handed to io_uring, run as one task. If the ring can not be
+// set up (kernel without io_uring) they are queued as ordinary file tasks.
+struct BATCH_URING {
+    struct BATCH_TASK task;         // First, the pool task is the group
+    struct BATCH_FILE **files;
+    struct BATCH_TASK **fallback;
+    int count;
+};
+
+static void batch_uring(struct THREAD_POOL *pool, int worker, struct BATCH_URING *group) {
+    if (uring_run(group->files, group->count, pool, worker) == 0) return;
+
+    for (int i = 0; i < group->count; i++) {
+        if (threads_pool_push(pool, worker, group->fallback[i]) != 0) {
+            batch_file(pool, worker, group->files[i]);
+        }
+    }
+}
+
+
+static void batch_task(struct THREAD_POOL *pool, int worker, void *arg) {
+    struct BATCH_TASK *task = (struct BATCH_TASK *)arg;
+
+    if (task->range >= 0) {
+        batch_range(task->file, (uint32_t)task->range);
+    } else if (task->range == BATCH_TASK_FILE) {
+        batch_file(pool, worker, task->file);
+    } else if (task->range == BATCH_TASK_BUFFER) {
+        struct BATCH_FILE *file = task->file;
+        file->crc = crc32_model_compute(file->model, file->map, (size_t)file->size);
+        __sync_synchronize();
+        file->ready = 1;
+    } else {
+        batch_uring(pool, worker, (struct BATCH_URING *)task);
+    }
+}
+
+
+int batch_list(struct BATCH_LIST *list, char **paths, int count) {
+    int failed = 0;
+
+    for (int i = 0; i < count; i++) {
+        if (batch_add_path(list, paths[i]) != 0) failed++;
+    }
+    return failed;
+}
+
+
+void batch_free(struct BATCH_LIST *list) {
+    for (int i = 0; i < list->count; i++) free(list->files[i].path);
+    free(list->files);
+    memset(list, 0, sizeof(*list));
+}
+
+
+double batch_run(const struct crc32_model *model, struct BATCH_LIST *list, int threads, int flags) {
+    struct BATCH_URING group;
+    int use_uring = !(flags & BATCH_BLOCKING) && uring_available();
+
+    memset(&group, 0, sizeof(group));
+    struct BATCH_TASK *tasks = (struct BATCH_TASK *)calloc(list->count, sizeof(struct BATCH_TASK));
+    struct THREAD_POOL *pool = threads_pool_create(threads, batch_task);
+    if (use_uring) {
+        group.files = (struct BATCH_FILE **)calloc(list->count, sizeof(struct BATCH_FILE *));
+        group.fallback = (struct BATCH_TASK **)calloc(list->count, sizeof(struct BATCH_TASK *));
+    }
+    if (tasks == NULL || pool == NULL || (use_uring && (group.files == NULL || group.fallback == NULL))) {
+        perror("Memory allocation for the batch failed");
+        free(tasks);
+        free(group.files);
+        free(group.fallback);
+        threads_pool_free(pool);
+        return -1;
+    }
+
+    // The files under URING_MAX_SIZE go to the io_uring task, the others are
+    // dealt round robin to the workers, idle ones steal from the others
+    int dealt = 0;
+    for (int i = 0; i < list->count; i++) {
+        struct BATCH_FILE *file = &list->files[i];
+        uint64_t size = file->listed_size;
+        char *path = file->path;
+
+        memset(file, 0, sizeof(*file));
+        file->path = path;
+        file->listed_size = size;
+        file->size = size;
+        file->model = model;
+        file->flags = flags;
+        tasks[i].file = file;
+        tasks[i].range = BATCH_TASK_FILE;
+
+        if (use_uring && size < URING_MAX_SIZE) {
+            group.files[group.count] = file;
+            group.fallback[group.count++] = &tasks[i];
+        } else if (threads_pool_push(pool, dealt++, &tasks[i]) != 0) {
+            file->error = 1;
+        }
+    }
+    group.task.range = BATCH_TASK_URING;
+    if (group.count > 0 && threads_pool_push(pool, dealt, &group.task) != 0) {
+        for (int i = 0; i < group.count; i++) group.files[i]->error = 1;
+    }
+
+    crc32_current_engine();     // Select the engine before the workers start
+    double start = threads_now();
+    threads_pool_run(pool);
+    double elapsed = threads_now() - start;
+
+    threads_pool_free(pool);
+    free(tasks);
+    free(group.files);
+    free(group.fallback);
+    return elapsed;
+}
+
+
+int batch_stamp(const struct crc32_model *model, char **paths, int count, int threads, int flags) {
+    struct BATCH_LIST list;
+
+    memset(&list, 0, sizeof(list));
+    int failed = batch_list(&list, paths, count);
+    if (list.count == 0) {
+        fprintf(stderr, "No files to stamp\n");
+        return failed ? failed : 1;
+    }
+
+    double elapsed = batch_run(model, &list, threads, flags);
+    if (elapsed < 0) {
+        failed = list.count;
+        batch_free(&list);
+        return failed;
+    }
+
+    uint64_t total = 0;
+    for (int i = 0; i < list.count; i++) {
+        struct BATCH_FILE *file = &list.files[i];
+        if (file->error) {
+            printf("FAILED      %s\n", file->path);
+            failed++;
+        } else {
+            printf("0x%08X  %s\n", file->crc, file->path);
+            total += file->size;
+        }
+    }
+
+    printf("%d files, %.1f MB in %.3f s, %.1f MB/s on %d workers (%s)\n",
+           list.count, total / 1e6, elapsed, (elapsed > 0) ? total / elapsed / 1e6 : 0.0,
+           (threads < THREADS_MAX) ? threads : THREADS_MAX, model->name);
+    if (failed) printf("%d files were not stamped\n", failed);
+
+    batch_free(&list);
+    return failed;
+}
+
+
+int batch_verify(const struct crc32_model *model, char **paths, int count, int threads, int flags) {
+    struct BATCH_LIST list;
+    int mismatched = 0, untrailed = 0, binary = 0;
+
+    memset(&list, 0, sizeof(list));
+    int failed = batch_list(&list, paths, count);
+    if (list.count == 0) {
+        fprintf(stderr, "No files to verify\n");
+        return failed ? failed : 1;
+    }
+
+    double elapsed = batch_run(model, &list, threads, flags | BATCH_VERIFY | BATCH_NO_WRITE);
+    if (elapsed < 0) {
+        failed = list.count;
+        batch_free(&list);
+        return failed;
+    }
+
+    // Only the files that fail are listed
+    uint64_t total = 0;
+    for (int i = 0; i < list.count; i++) {
+        struct BATCH_FILE *file = &list.files[i];
+        if (file->error) {
+            printf("FAILED      %s\n", file->path);
+            failed++;
+        } else if (file->verdict == BATCH_OK) {
+            if (file->binary) binary++;
+        } else if (file->verdict == BATCH_NO_TRAILER) {
+            printf("NO TRAILER  %s (or a binary one that does not match)\n", file->path);
+            untrailed++;
+        } else if (file->verdict == BATCH_MISMATCH) {
+            printf("MISMATCH    %s (trailer 0x%08X, data 0x%08X)\n", file->path, file->trailer, file->crc);
+            mismatched++;
+        }
+        total += file->listed_size;
+    }
+
+    printf("%d files, %.1f MB in %.3f s, %.1f MB/s on %d workers (%s)\n",
+           list.count, total / 1e6, elapsed, (elapsed > 0) ? total / elapsed / 1e6 : 0.0,
+           (threads < THREADS_MAX) ? threads : THREADS_MAX, model->name);
+    printf("%d ok (%d binary trailers), %d mismatched, %d without trailer, %d failed\n",
+           list.count - mismatched - untrailed - failed, binary, mismatched, untrailed, failed);
+
+    batch_free(&list);
+    return failed + mismatched + untrailed;
+}
+
+
+int batch_bench(const struct crc32_model *model, char **paths, int count, int threads) {
+    static const char *names[2] = { "blocking", "io_uring" };
+    struct BATCH_LIST list;
+    uint32_t *crc = NULL;
+    int result = 0;
+
+    memset(&list, 0, sizeof(list));
+    if (batch_list(&list, paths, count) != 0 || list.count == 0) {
+        batch_free(&list);
+        return 1;
+    }
+    crc = (uint32_t *)calloc(list.count, sizeof(uint32_t));
+    if (crc == NULL) {
+        batch_free(&list);
+        return 1;
+    }
+
+    uint64_t total = 0;
+    for (int i = 0; i < list.count; i++) total += list.files[i].listed_size;
+    printf("%d files, %.1f MB, %d workers\n", list.count, total / 1e6, threads);
+
+    for (int mode = 0; mode < 2; mode++) {
+        if (mode == 1 && !uring_available()) {
+            printf("%-9s not available on this system\n", names[mode]);
+            break;
+        }
+
+        double best = 0;
+        for (int run = 0; run < BENCH_RUNS; run++) {
+            double elapsed = batch_run(model, &list, threads, BATCH_NO_WRITE | (mode ? 0 : BATCH_BLOCKING));
+            if (elapsed < 0) {
+                result = 1;
+                break;
+            }
+            if (run == 0 || elapsed < best) best = elapsed;
+        }
+
+        // Both paths must find the same CRCs
+        int errors = 0;
+        for (int i = 0; i < list.count; i++) {
+            if (list.files[i].error) errors++;
+            else if (mode == 0) crc[i] = list.files[i].crc;
+            else if (crc[i] != list.files[i].crc) errors++;
+        }
+
+        printf("%-9s %10.1f MB/s %10.0f files/s%s\n", names[mode], total / best / 1e6,
+               list.count / best, errors ? "  ERRORS" : "");
+        if (errors) result = 1;
+    }
+
+    free(crc);
+    batch_free(&list);
+    return result;
+}
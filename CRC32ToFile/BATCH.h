@@ -0,0 +1,98 @@
+#ifndef __BATCH_H__
+#define __BATCH_H__
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "CRC32.h"
+
+// batch_run() flags
+#define BATCH_NO_WRITE    0x01      // Only compute the CRCs, the files are not modified (--bench)
+#define BATCH_BLOCKING    0x02      // fopen/fread every file, no io_uring (--io=blocking)
+#define BATCH_VERIFY      0x04      // Check the trailers instead of appending them (--verify)
+#define BATCH_BINARY      0x08      // 4 byte binary trailer (--trailer=binary)
+
+// --verify result of a file
+#define BATCH_OK          0
+#define BATCH_MISMATCH    1         // The trailer is not the CRC of the data
+#define BATCH_NO_TRAILER  2         // Not a binary trailer, and the last 8 bytes are not hex digits
+
+// One file of the batch, and the state of its ranges when it is split
+struct BATCH_FILE {
+    char *path;
+    const struct crc32_model *model;
+    int flags;
+    FILE *file;
+    const uint8_t *map;             // Mapping, or the io_uring read buffer
+    uint64_t map_size;
+    uint64_t listed_size;           // From the directory walk, io_uring reads this many bytes
+    uint64_t size;                  // Bytes CRCed, the trailer is not counted with BATCH_VERIFY
+    uint32_t crc;
+    int error;
+    uint8_t tail[8];                // BATCH_VERIFY: the last bytes, not in size
+    int tail_len;
+    uint32_t trailer;               // BATCH_VERIFY: CRC of a text trailer
+    int binary;                     // BATCH_VERIFY: the file has a binary trailer
+    int verdict;                    // BATCH_VERIFY: BATCH_OK, BATCH_MISMATCH, BATCH_NO_TRAILER
+    volatile int ready;             // io_uring: the worker has computed crc
+
+    uint64_t range_size;
+    uint32_t range_count;
+    volatile uint32_t ranges_left;  // The worker that finishes the last range appends the trailer
+    volatile int range_error;
+    uint32_t *range_crc;
+    struct BATCH_TASK *ranges;
+};
+
+// Pool task: a whole file, one range of a split file, the CRC of a buffer read
+// by io_uring, or the io_uring loop over a group of small files
+#define BATCH_TASK_FILE   -1
+#define BATCH_TASK_BUFFER -2
+#define BATCH_TASK_URING  -3
+
+struct BATCH_TASK {
+    struct BATCH_FILE *file;
+    int32_t range;                  // >= 0 for a range, or one of BATCH_TASK_...
+};
+
+struct BATCH_LIST {
+    struct BATCH_FILE *files;
+    int count;
+    int capacity;
+};
+
+// Files of paths (files, and the files of the directories walked recursively)
+// added to list. Return the number of paths that could not be read.
+int batch_list(struct BATCH_LIST *list, char **paths, int count);
+void batch_free(struct BATCH_LIST *list);
+
+// Stamp every file of list with the trailer the single file mode appends, on a
+// work stealing pool of threads workers. Files of FILECRC_PARALLEL_MIN and more
+// are split in ranges that idle workers steal, on Linux the small files go
+// through io_uring. Return the seconds it took, -1 if out of memory.
+double batch_run(const struct crc32_model *model, struct BATCH_LIST *list, int threads, int flags);
+
+// Batch mode of CRC32ToFile: list, run, print one line per file and the
+// aggregate MB/s. Return the number of files that could not be stamped.
+int batch_stamp(const struct crc32_model *model, char **paths, int count, int threads, int flags);
+
+// --bench on several files or folders: MB/s and files/s of the blocking and
+// of the io_uring path, the files are not modified
+int batch_bench(const struct crc32_model *model, char **paths, int count, int threads);
+
+// --verify: keep the last (up to) 8 of size bytes, which end at end, in
+// file->tail and set file->size to the bytes before them
+void batch_split_trailer(struct BATCH_FILE *file, const uint8_t *end, uint64_t size);
+
+// --verify: once the CRC of file->size bytes is done, carry it on over the
+// tail for a binary trailer (residue), else compare it with a text trailer
+void batch_check(struct BATCH_FILE *file);
+
+// Batch verify mode: like batch_stamp, prints the files whose trailer does not
+// match. Return the number of files that failed the check.
+int batch_verify(const struct crc32_model *model, char **paths, int count, int threads, int flags);
+
+// 1 if path is a directory
+int batch_is_directory(const char *path);
+
+#endif // BATCH_H
@@ -2,6 +2,20 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "CRC32.h"
+#include "FILECRC.h"
+#include "THREADS.h"
+#include "BATCH.h"
+#include "APPEND.h"
+#include "MANIFEST.h"
+
+#define USAGE "[--poly=crc32|crc32c|crc32k] [--engine=bitwise|slice8|slice16|pclmul|vpclmul|table|halfword] [--retune] [--threads=N] [--trailer=text|binary] [--bench] <filename>\n" \
+              "       %s [--poly=...] [--engine=...] [--threads=N] [--trailer=...] [--io=uring|blocking] [--bench] <file|directory> ...\n" \
+              "       %s [--poly=...] [--threads=N] [--io=uring|blocking] --verify <file|directory> ...\n" \
+              "       %s [--poly=...] --incremental <file> ...\n" \
+              "       %s --manifest [--cluster=N] <file> ..."
+
+#define BENCH_RUNS 5                // --bench keeps the best of this many passes
 
 // To compute CRC32 for a file
 // https://simplycalc.com/crc32-file.php#
@@ -25,54 +39,266 @@ unsigned int crc32b(unsigned char *message) {
 }
 
 // Function to compute the CRC of a file
-unsigned int compute_file_crc(FILE *file) {
+unsigned int compute_file_crc(const struct crc32_model *model, FILE *file) {
     unsigned char buffer[1024];
     size_t bytesRead;
-    unsigned int crc = 0xFFFFFFFF;
+    uint32_t crc = crc32_model_start(model);
     
+    // For CRC-32 the engine (bitwise, slice8, slice16, pclmul, vpclmul) is chosen with crc32_select_engine()
     while ((bytesRead = fread(buffer, 1, sizeof(buffer), file)) > 0) {
-        for (size_t i = 0; i < bytesRead; i++) {
-            crc ^= buffer[i];
-            for (int j = 7; j >= 0; j--) {
-                unsigned int mask = -(crc & 1);
-                crc = (crc >> 1) ^ (0xEDB88320 & mask);
-            }
+        crc = crc32_model_update(model, crc, buffer, bytesRead);
+    }
+
+    return crc32_model_finish(model, crc);
+}
+
+// --bench: MB/s of the fread loop and of the memory mapping on this file,
+// the file is not modified. Run it on files around FILECRC_MMAP_MIN to set it.
+static int bench_file(const struct crc32_model *model, FILE *file, uint64_t size) {
+    double buffered = 0, mapped = 0;
+    uint32_t crc_buffered = 0, crc_mapped = 0;
+
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        rewind(file);
+        double start = threads_now();
+        crc_buffered = compute_file_crc(model, file);
+        double elapsed = threads_now() - start;
+        if (buffered == 0 || elapsed < buffered) buffered = elapsed;
+
+        start = threads_now();
+        const uint8_t *map = filecrc_map(file, size);
+        if (map == NULL) {
+            printf("The file can not be mapped, only fread can be used\n");
+            return 1;
         }
+        crc_mapped = crc32_model_compute(model, map, (size_t)size);
+        filecrc_unmap(map, size);
+        elapsed = threads_now() - start;
+        if (mapped == 0 || elapsed < mapped) mapped = elapsed;
     }
 
-    return ~crc;
+    printf("%llu bytes, CRC 0x%08X (%s)\n", (unsigned long long)size, crc_buffered, model->name);
+    printf("fread %10.1f MB/s\n", size / buffered / 1e6);
+    printf("mmap  %10.1f MB/s\n", size / mapped / 1e6);
+    printf("%s is faster, FILECRC_MMAP_MIN is %u bytes\n",
+           (mapped < buffered) ? "mmap" : "fread", (unsigned)FILECRC_MMAP_MIN);
+    if (crc_buffered != crc_mapped) {
+        printf("MISMATCH: the mapped CRC is 0x%08X\n", crc_mapped);
+        return 1;
+    }
+    return 0;
 }
 
 int main(int argc, char *argv[]) {
-    if (argc != 2) {
-        fprintf(stderr, "Usage: %s <filename>\n", argv[0]);
+    char **paths = (char **)calloc(argc, sizeof(char *));
+    int path_count = 0;
+    const struct crc32_model *model = &crc32_model_ieee;   // Trailer CRC, compatible with crc32b
+    int engine = -1;                // Fastest for this CPU, see crc32_autotune()
+    int retune = 0;
+    int bench = 0;
+    int verify = 0;
+    int incremental = 0;
+    int manifest = 0;
+    uint32_t cluster_size = MANIFEST_CLUSTER;
+    int batch_flags = 0;
+    int threads = threads_cpu_count();
+
+    // Command line options, see USAGE
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--poly=", 7) == 0) {
+            model = crc32_model_from_name(argv[i] + 7);
+            if (model == NULL) {
+                fprintf(stderr, "Unknown CRC polynomial: %s\n", argv[i] + 7);
+                return 1;
+            }
+        } else if (strncmp(argv[i], "--engine=", 9) == 0) {
+            engine = crc32_engine_from_name(argv[i] + 9);
+            if (engine < 0) {
+                fprintf(stderr, "Unknown CRC engine: %s\n", argv[i] + 9);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--retune") == 0) {
+            retune = 1;
+        } else if (strncmp(argv[i], "--threads=", 10) == 0) {
+            threads = atoi(argv[i] + 10);   // 1 = sequential
+            if (threads < 1) threads = 1;
+        } else if (strcmp(argv[i], "--bench") == 0) {
+            bench = 1;
+        } else if (strcmp(argv[i], "--manifest") == 0) {
+            manifest = 1;
+        } else if (strncmp(argv[i], "--cluster=", 10) == 0) {
+            // Bytes per cluster of the image: sector size x sectors per cluster
+            cluster_size = (uint32_t)strtoul(argv[i] + 10, NULL, 10);
+            if (cluster_size < 512 || cluster_size > 65536 || (cluster_size & (cluster_size - 1)) != 0) {
+                fprintf(stderr, "Invalid cluster size: %s\n", argv[i] + 10);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--incremental") == 0) {
+            incremental = 1;
+        } else if (strcmp(argv[i], "--verify") == 0) {
+            verify = 1;
+        } else if (strcmp(argv[i], "--trailer=binary") == 0) {
+            batch_flags |= BATCH_BINARY;    // 4 bytes, the CRC of the stamped file is the residue
+        } else if (strcmp(argv[i], "--trailer=text") == 0) {
+            batch_flags &= ~BATCH_BINARY;
+        } else if (strcmp(argv[i], "--io=blocking") == 0) {
+            batch_flags |= BATCH_BLOCKING;  // No io_uring in batch mode
+        } else if (strcmp(argv[i], "--io=uring") == 0) {
+            batch_flags &= ~BATCH_BLOCKING;
+        } else if (paths != NULL) {
+            paths[path_count++] = argv[i];
+        }
+    }
+
+    if (path_count == 0) {
+        fprintf(stderr, "Usage: %s " USAGE "\n", argv[0], argv[0], argv[0], argv[0], argv[0]);
         return 1;
     }
 
-    FILE *file = fopen(argv[1], "r+b"); // Open file for reading and writing
+    if (engine >= 0) {
+        crc32_select_engine(engine);
+    } else {
+        char tune_file[1024];
+        crc32_tune_path(tune_file, sizeof(tune_file), argv[0]);
+        crc32_autotune(tune_file, retune);
+    }
+
+    // --manifest: one CRC-32 per FAT12 cluster, for readFAT12 to check the
+    // clusters as it streams them
+    if (manifest) {
+        // A.HTM and A.TXT share A.CRM, the second one would overwrite the first
+        char **written = (char **)calloc(path_count, sizeof(char *));
+        int failed = 0;
+        for (int i = 0; i < path_count; i++) {
+            char *path = manifest_path(paths[i]);
+            int clusters = -1;
+            int taken = -1;
+            for (int j = 0; path != NULL && written != NULL && j < i && taken < 0; j++) {
+                if (written[j] != NULL && manifest_same_path(written[j], path)) taken = j;
+            }
+            if (path == NULL || written == NULL) {
+                perror("Memory allocation for the manifest failed");
+            } else if (taken >= 0) {
+                fprintf(stderr, "%s: %s is already the manifest of %s\n", paths[i], path, paths[taken]);
+            } else {
+                clusters = manifest_write(paths[i], path, cluster_size);
+            }
+
+            if (clusters < 0) {
+                printf("FAILED      %s\n", paths[i]);
+                failed++;
+                free(path);
+            } else {
+                printf("%s: manifest of %d clusters of %u bytes\n", paths[i], clusters, cluster_size);
+                written[i] = path;
+            }
+        }
+        for (int i = 0; written != NULL && i < path_count; i++) free(written[i]);
+        free(written);
+        free(paths);
+        return failed != 0;
+    }
+
+    // --incremental: files that only grow, nothing is appended to them
+    if (incremental) {
+        int failed = 0;
+        for (int i = 0; i < path_count; i++) {
+            static const char *how[3] = { "unchanged", "appended", "full" };
+            uint32_t incremental_crc;
+            uint64_t new_bytes;
+            int result = append_crc(model, paths[i], &incremental_crc, &new_bytes);
+            if (result < 0) {
+                printf("FAILED      %s\n", paths[i]);
+                failed++;
+            } else {
+                printf("0x%08X  %s (%s, %llu bytes CRCed)\n", incremental_crc, paths[i], how[result],
+                       (unsigned long long)new_bytes);
+            }
+        }
+        free(paths);
+        return failed != 0;
+    }
+
+    // --verify goes through the batch mode for a single file too
+    if (verify) {
+        int failed = batch_verify(model, paths, path_count, threads, batch_flags);
+        free(paths);
+        return failed != 0;
+    }
+
+    // Several files, or directories: batch mode on a work stealing pool
+    if (path_count > 1 || batch_is_directory(paths[0])) {
+        int failed = bench ? batch_bench(model, paths, path_count, threads)
+                           : batch_stamp(model, paths, path_count, threads, batch_flags);
+        free(paths);
+        return failed != 0;
+    }
+
+    const char *filename = paths[0];
+    free(paths);
+
+    FILE *file = fopen(filename, "r+b"); // Open file for reading and writing
     if (!file) {
         perror("Error opening file");
         return 1;
     }
 
-    // Compute CRC of the file
-    unsigned int crc = compute_file_crc(file);
+    // Compute CRC of the file, big files are split in ranges CRCed on all cores
+    unsigned int crc;
+    int64_t size = filecrc_size(file);
+    if (size < 0) {
+        perror("Error getting the file size");
+        fclose(file);
+        return 1;
+    }
+
+    if (bench) {
+        int result = bench_file(model, file, (uint64_t)size);
+        fclose(file);
+        return result;
+    }
+
+    // Big files are CRCed in place in a read only mapping, no copy through fread
+    const uint8_t *map = NULL;
+    if ((uint64_t)size >= FILECRC_MMAP_MIN) map = filecrc_map(file, (uint64_t)size);
+
+    if (threads > 1 && size >= FILECRC_PARALLEL_MIN) {
+        uint32_t parallel_crc;
+        if (filecrc_parallel(model, filename, map, (uint64_t)size, threads, &parallel_crc) != 0) {
+            filecrc_unmap(map, (uint64_t)size);
+            fclose(file);
+            return 1;
+        }
+        crc = parallel_crc;
+    } else if (map) {
+        crc = crc32_model_compute(model, map, (size_t)size);
+    } else {
+        crc = compute_file_crc(model, file);
+    }
+    filecrc_unmap(map, (uint64_t)size);
     
     
     // Create a string to hold the hexadecimal representation of the CRC
     char crc_hex[9]; // 8 characters for CRC + null terminator
     snprintf(crc_hex, sizeof(crc_hex), "%08X", crc);
+    size_t trailer_len = strlen(crc_hex);
 
-    fseek(file, 0, SEEK_END); // Move to the end of the file
+    // --trailer=binary: the 4 bytes of the CRC instead, so that the CRC of the
+    // stamped file is crc32_model_residue() and is checked in one pass
+    if (batch_flags & BATCH_BINARY) {
+        crc32_model_store(model, crc, (uint8_t *)crc_hex);
+        trailer_len = 4;
+    }
 
-    // Append the CRC value as an 8-character hexadecimal string
-    if (fwrite(crc_hex, sizeof(char), strlen(crc_hex), file) != strlen(crc_hex)) {
+    // Append the CRC value as an 8-character hexadecimal string, one positioned
+    // write at the end of the data that was CRCed
+    if (filecrc_write_at(file, (uint64_t)size, crc_hex, trailer_len) != 0) {
         perror("Error writing CRC to file");
         fclose(file);
         return 1;
     }
 
     fclose(file);
-    printf("CRC appended successfully: 0x%08X\n", crc);
+    printf("CRC appended successfully: 0x%08X (%s)\n", crc, model->name);
     return 0;
 }
@@ -0,0 +1,260 @@
+
+#define _FILE_OFFSET_BITS 64    // fseeko/ftello past 2 GB on 32-bit POSIX hosts
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "CRC32.h"
+#include "FILECRC.h"
+#include "THREADS.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#define file_seek64 _fseeki64
+#define file_tell64 _ftelli64
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#define file_seek64 fseeko
+#define file_tell64 ftello
+#endif
+
+
+int64_t filecrc_size(FILE *file) {
+    if (file_seek64(file, 0, SEEK_END) != 0) return -1;
+    int64_t size = file_tell64(file);
+    rewind(file);
+    return size;
+}
+
+
+const uint8_t *filecrc_map(FILE *file, uint64_t size) {
+    if (size == 0 || size != (uint64_t)(size_t)size) return NULL;
+
+#ifdef _WIN32
+    HANDLE handle = (HANDLE)_get_osfhandle(_fileno(file));
+    HANDLE mapping = CreateFileMapping(handle, NULL, PAGE_READONLY,
+                                       (DWORD)(size >> 32), (DWORD)size, NULL);
+    if (mapping == NULL) return NULL;
+
+    // The view keeps the mapping object alive
+    const uint8_t *map = (const uint8_t *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, (SIZE_T)size);
+    CloseHandle(mapping);
+    return map;
+#else
+    void *map = mmap(NULL, (size_t)size, PROT_READ, MAP_SHARED, fileno(file), 0);
+    if (map == MAP_FAILED) return NULL;
+
+    // Read ahead aggressively and drop the pages behind, like a sequential fread
+    madvise(map, (size_t)size, MADV_SEQUENTIAL);
+    return (const uint8_t *)map;
+#endif
+}
+
+
+void filecrc_unmap(const uint8_t *map, uint64_t size) {
+    if (map == NULL) return;
+#ifdef _WIN32
+    (void)size;
+    UnmapViewOfFile(map);
+#else
+    munmap((void *)map, (size_t)size);
+#endif
+}
+
+
+int filecrc_write_at(FILE *file, uint64_t offset, const void *data, size_t len) {
+#ifdef _WIN32
+    HANDLE handle = (HANDLE)_get_osfhandle(_fileno(file));
+    OVERLAPPED position;
+    DWORD written = 0;
+
+    memset(&position, 0, sizeof(position));
+    position.Offset = (DWORD)offset;
+    position.OffsetHigh = (DWORD)(offset >> 32);
+    if (!WriteFile(handle, data, (DWORD)len, &written, &position)) return -1;
+    return (written == len) ? 0 : -1;
+#else
+    ssize_t written = pwrite(fileno(file), data, len, (off_t)offset);
+    return (written == (ssize_t)len) ? 0 : -1;
+#endif
+}
+
+
+int filecrc_read_at(FILE *file, uint64_t offset, void *data, size_t len) {
+    int result = -1;
+
+    if (file_seek64(file, (int64_t)offset, SEEK_SET) == 0 && fread(data, 1, len, file) == len) {
+        result = 0;
+    }
+    rewind(file);
+    return result;
+}
+
+
+// CRC of length bytes at start read through buffer (FILECRC_READ_SIZE bytes)
+static int filecrc_read_range(const struct crc32_model *model, FILE *file, unsigned char *buffer,
+                              const char *filename, uint64_t start, uint64_t length, uint32_t *range_crc) {
+    if (file_seek64(file, (int64_t)start, SEEK_SET) != 0) {
+        perror("Error seeking in file");
+        return -1;
+    }
+
+    uint32_t crc = crc32_model_start(model);
+    uint64_t remaining = length;
+    while (remaining > 0) {
+        size_t want = (remaining < FILECRC_READ_SIZE) ? (size_t)remaining : FILECRC_READ_SIZE;
+        size_t got = fread(buffer, 1, want, file);
+        if (got != want) {
+            fprintf(stderr, "Error: short read in %s at offset %llu\n",
+                    filename, (unsigned long long)(start + (length - remaining)));
+            return -1;
+        }
+        crc = crc32_model_update(model, crc, buffer, got);
+        remaining -= got;
+    }
+    *range_crc = crc32_model_finish(model, crc);
+    return 0;
+}
+
+
+int filecrc_range(const struct crc32_model *model, const char *filename, const uint8_t *map,
+                  uint64_t start, uint64_t length, uint32_t *crc) {
+    if (map) {
+        *crc = crc32_model_compute(model, map + start, (size_t)length);
+        return 0;
+    }
+
+    FILE *file = fopen(filename, "rb");
+    unsigned char *buffer = (unsigned char *)malloc(FILECRC_READ_SIZE);
+    int result = -1;
+    if (file == NULL || buffer == NULL) {
+        perror("Error opening file for a CRC worker");
+    } else {
+        result = filecrc_read_range(model, file, buffer, filename, start, length, crc);
+    }
+    if (file) fclose(file);
+    free(buffer);
+    return result;
+}
+
+
+uint64_t filecrc_range_size(uint64_t size, int threads) {
+    if (threads < 1) threads = 1;
+
+    // About four ranges per worker, so a slow worker does not hold up the others
+    uint64_t range_size = size / ((uint64_t)threads * 4);
+    if (range_size < FILECRC_RANGE_MIN) range_size = FILECRC_RANGE_MIN;
+    return (range_size + FILECRC_READ_SIZE - 1) & ~(uint64_t)(FILECRC_READ_SIZE - 1);
+}
+
+
+uint32_t filecrc_merge(const struct crc32_model *model, const uint32_t *range_crc,
+                       uint64_t size, uint64_t range_size) {
+    uint32_t count = (uint32_t)((size + range_size - 1) / range_size);
+    uint32_t result = range_crc[0];
+
+    // Merge the ranges in file order
+    for (uint32_t r = 1; r < count; r++) {
+        uint64_t length = size - (uint64_t)r * range_size;
+        if (length > range_size) length = range_size;
+        result = crc32_model_combine(model, result, range_crc[r], length);
+    }
+    return result;
+}
+
+
+// One file split in ranges, the workers take the next range from next_range
+struct FILECRC_JOB {
+    const struct crc32_model *model;
+    const char *filename;
+    const uint8_t *map;         // Whole file mapped, or NULL to fread it
+    uint64_t size;
+    uint64_t range_size;
+    uint32_t range_count;
+    volatile uint32_t next_range;
+    volatile int error;
+    uint32_t *range_crc;        // Finished CRC of each range
+};
+
+
+static void filecrc_worker(void *arg, int index) {
+    struct FILECRC_JOB *job = (struct FILECRC_JOB *)arg;
+    unsigned char *buffer = NULL;
+    FILE *file = NULL;
+    uint32_t range;
+
+    (void)index;
+
+    while ((range = threads_fetch_add(&job->next_range, 1)) < job->range_count) {
+        if (job->error) break;
+
+        uint64_t start = (uint64_t)range * job->range_size;
+        uint64_t length = job->size - start;
+        if (length > job->range_size) length = job->range_size;
+
+        if (job->map) {
+            job->range_crc[range] = crc32_model_compute(job->model, job->map + start, (size_t)length);
+            continue;
+        }
+
+        // Each worker has its own stream and buffer, opened on the first range it gets
+        if (file == NULL) {
+            file = fopen(job->filename, "rb");
+            buffer = (unsigned char *)malloc(FILECRC_READ_SIZE);
+            if (file == NULL || buffer == NULL) {
+                perror("Error opening file for a CRC worker");
+                job->error = 1;
+                break;
+            }
+        }
+
+        if (filecrc_read_range(job->model, file, buffer, job->filename, start, length,
+                               &job->range_crc[range]) != 0) {
+            job->error = 1;
+            break;
+        }
+    }
+
+    if (file) fclose(file);
+    free(buffer);
+}
+
+
+int filecrc_parallel(const struct crc32_model *model, const char *filename, const uint8_t *map,
+                     uint64_t size, int threads, uint32_t *crc) {
+    struct FILECRC_JOB job;
+
+    if (threads < 1) threads = 1;
+
+    memset(&job, 0, sizeof(job));
+    job.model = model;
+    job.filename = filename;
+    job.map = map;
+    job.size = size;
+    job.range_size = filecrc_range_size(size, threads);
+    job.range_count = (uint32_t)((size + job.range_size - 1) / job.range_size);
+    if (job.range_count == 0) job.range_count = 1;
+    job.range_crc = (uint32_t *)calloc(job.range_count, sizeof(uint32_t));
+    if (job.range_crc == NULL) {
+        perror("Memory allocation for the range CRCs failed");
+        return -1;
+    }
+
+    if ((uint32_t)threads > job.range_count) threads = (int)job.range_count;
+
+    crc32_current_engine();     // Select the engine before the workers start
+    threads_run(threads, filecrc_worker, &job);
+
+    if (job.error) {
+        free(job.range_crc);
+        return -1;
+    }
+
+    *crc = filecrc_merge(model, job.range_crc, size, job.range_size);
+    free(job.range_crc);
+    return 0;
+}
@@ -0,0 +1,58 @@
+#ifndef __FILECRC_H__
+#define __FILECRC_H__
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "CRC32.h"
+
+// Files at least this big are split in ranges and CRCed on several threads
+#ifndef FILECRC_PARALLEL_MIN
+#define FILECRC_PARALLEL_MIN (8u << 20)     // 8 MiB
+#endif
+
+// Smallest range given to one worker
+#define FILECRC_RANGE_MIN (1u << 20)        // 1 MiB
+
+#define FILECRC_READ_SIZE (64u << 10)       // fread block of the workers
+
+// Files at least this big are mapped in memory and CRCed in place instead of
+// being copied through fread buffers (measure with CRC32ToFile --bench)
+#ifndef FILECRC_MMAP_MIN
+#define FILECRC_MMAP_MIN (256u << 10)       // 256 KiB
+#endif
+
+// Size of an open file (leaves the position at the start), -1 on error
+int64_t filecrc_size(FILE *file);
+
+// Read only view of the first size bytes of an open file, marked for sequential
+// access. NULL if it can not be mapped (empty file, no address space on a
+// 32-bit build, ...), the caller then reads the file with fread.
+const uint8_t *filecrc_map(FILE *file, uint64_t size);
+void filecrc_unmap(const uint8_t *map, uint64_t size);
+
+// Write len bytes at offset with one positioned write, without moving the
+// stream position. Return 0 on success.
+int filecrc_write_at(FILE *file, uint64_t offset, const void *data, size_t len);
+
+// Ranges of a big file: filecrc_range_size() gives the size of every range but
+// the last one for this many workers, filecrc_range() computes the finished CRC
+// of one range (from map, or through its own stream when map is NULL) and
+// filecrc_merge() combines the CRCs of all the ranges in file order.
+uint64_t filecrc_range_size(uint64_t size, int threads);
+int filecrc_range(const struct crc32_model *model, const char *filename, const uint8_t *map,
+                  uint64_t start, uint64_t length, uint32_t *crc);
+uint32_t filecrc_merge(const struct crc32_model *model, const uint32_t *range_crc,
+                       uint64_t size, uint64_t range_size);
+
+// Read len bytes at offset, leaves the position at the start. Return 0 on success.
+int filecrc_read_at(FILE *file, uint64_t offset, void *data, size_t len);
+
+// CRC (of the given model) of size bytes of filename, split in ranges computed
+// by up to threads workers and merged with crc32_model_combine. With map (from
+// filecrc_map) the workers CRC the mapping, otherwise each one opens the file.
+// Return 0 on success.
+int filecrc_parallel(const struct crc32_model *model, const char *filename, const uint8_t *map,
+                     uint64_t size, int threads, uint32_t *crc);
+
+#endif // FILECRC_H
@@ -0,0 +1,140 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+
+#include "CRC32.h"
+#include "FILECRC.h"
+#include "MANIFEST.h"
+
+#define MANIFEST_MAGIC  "CRCM"
+#define MANIFEST_HEADER 28      // Magic, cluster size, file size, count, 8.3 name, 0
+#define MANIFEST_NAME   11
+
+
+static void manifest_put32(uint8_t *p, uint32_t value) {
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+    p[2] = (uint8_t)(value >> 16);
+    p[3] = (uint8_t)(value >> 24);
+}
+
+
+// The name of filename as in its FAT12 directory entry: "A.HTM" is "A       HTM".
+// Return -1 if it is not an 8.3 name.
+static int manifest_raw_name(const char *filename, char *raw) {
+    const char *name = filename;
+    for (const char *p = filename; *p; p++) {
+        if (*p == '/' || *p == '\\') name = p + 1;
+    }
+    const char *dot = strrchr(name, '.');
+    size_t stem = (dot != NULL) ? (size_t)(dot - name) : strlen(name);
+    size_t ext = (dot != NULL) ? strlen(dot + 1) : 0;
+    if (stem == 0 || stem > 8 || ext > 3) return -1;
+
+    memset(raw, ' ', MANIFEST_NAME);
+    for (size_t i = 0; i < stem; i++) raw[i] = (char)toupper((unsigned char)name[i]);
+    for (size_t i = 0; i < ext; i++) raw[8 + i] = (char)toupper((unsigned char)dot[1 + i]);
+    return 0;
+}
+
+
+char *manifest_path(const char *filename) {
+    size_t len = strlen(filename);
+    char *path = (char *)malloc(len + sizeof(MANIFEST_SUFFIX));
+    if (path == NULL) return NULL;
+
+    memcpy(path, filename, len + 1);
+    char *dot = strrchr(path, '.');
+    char *slash = strrchr(path, '/');
+    char *backslash = strrchr(path, '\\');
+    if (backslash > slash) slash = backslash;
+    if (dot == NULL || (slash != NULL && dot < slash)) dot = path + len;
+    strcpy(dot, MANIFEST_SUFFIX);
+    return path;
+}
+
+
+int manifest_same_path(const char *a, const char *b) {
+    while (*a != '\0' && toupper((unsigned char)*a) == toupper((unsigned char)*b)) {
+        a++;
+        b++;
+    }
+    return toupper((unsigned char)*a) == toupper((unsigned char)*b);
+}
+
+
+int manifest_write(const char *filename, const char *path, uint32_t cluster_size) {
+    char raw[MANIFEST_NAME];
+    if (manifest_raw_name(filename, raw) != 0) {
+        fprintf(stderr, "%s: not an 8.3 name, readFAT12 cannot find it\n", filename);
+        return -1;
+    }
+
+    FILE *file = fopen(filename, "rb");
+    if (file == NULL) {
+        perror(filename);
+        return -1;
+    }
+
+    int64_t size = filecrc_size(file);
+    if (size < 0 || size > UINT32_MAX) {
+        fprintf(stderr, "%s: no size, or too big for FAT12\n", filename);
+        fclose(file);
+        return -1;
+    }
+
+    uint32_t count = (uint32_t)(((uint64_t)size + cluster_size - 1) / cluster_size);
+    size_t manifest_size = MANIFEST_HEADER + (size_t)count * 4 + 4;
+    uint8_t *manifest = (uint8_t *)malloc(manifest_size);
+    uint8_t *cluster = (uint8_t *)malloc(cluster_size);
+    if (manifest == NULL || cluster == NULL) {
+        perror("Memory allocation for the manifest failed");
+        free(manifest);
+        free(cluster);
+        fclose(file);
+        return -1;
+    }
+
+    memcpy(manifest, MANIFEST_MAGIC, 4);
+    manifest_put32(manifest + 4, cluster_size);
+    manifest_put32(manifest + 8, (uint32_t)size);
+    manifest_put32(manifest + 12, count);
+    memcpy(manifest + 16, raw, MANIFEST_NAME);
+    manifest[16 + MANIFEST_NAME] = 0;
+
+    // One CRC-32 per cluster, the last one is short
+    int result = (int)count;
+    for (uint32_t i = 0; i < count; i++) {
+        uint64_t left = (uint64_t)size - (uint64_t)i * cluster_size;
+        size_t len = (left < cluster_size) ? (size_t)left : cluster_size;
+        if (fread(cluster, 1, len, file) != len) {
+            fprintf(stderr, "%s: short read\n", filename);
+            result = -1;
+            break;
+        }
+        manifest_put32(manifest + MANIFEST_HEADER + i * 4, crc32_compute(cluster, len));
+    }
+    fclose(file);
+
+    // Binary trailer, the manifest checks itself by the CRC-32 residue
+    if (result >= 0) {
+        crc32_model_store(&crc32_model_ieee, crc32_compute(manifest, manifest_size - 4),
+                          manifest + manifest_size - 4);
+
+        FILE *out = fopen(path, "wb");
+        if (out == NULL || fwrite(manifest, 1, manifest_size, out) != manifest_size) {
+            perror(path);
+            result = -1;
+        }
+        if (out != NULL && fclose(out) != 0) {
+            perror(path);
+            result = -1;
+        }
+    }
+
+    free(manifest);
+    free(cluster);
+    return result;
+}
@@ -0,0 +1,26 @@
+#ifndef __MANIFEST_H__
+#define __MANIFEST_H__
+
+#include <stdint.h>
+
+// Per cluster CRC manifest for readFAT12 (see struct FAT12_MANIFEST in
+// readFAT12/FAT12/FAT12.h): one CRC-32 per cluster of the file, so the MCU
+// checks each cluster as it streams it instead of the whole file at the end.
+// Written next to the file as <name>.CRM, to be copied in the image with it.
+
+#define MANIFEST_CLUSTER 4096       // Cluster of the 25Q32 FAT12 image, --cluster=N for others
+#define MANIFEST_SUFFIX  ".CRM"
+
+// <name>.CRM next to filename, the extension is replaced to keep an 8.3 name,
+// so A.HTM and A.TXT share it. Free it after use, NULL if out of memory.
+char *manifest_path(const char *filename);
+
+// 1 if the two manifest paths name the same file. Letter case is ignored,
+// FAT12 and Windows names do not keep it.
+int manifest_same_path(const char *a, const char *b);
+
+// Write the manifest of filename to path, with the 8.3 name of the file in it
+// for readFAT12 to match. Return the number of clusters, -1 on error.
+int manifest_write(const char *filename, const char *path, uint32_t cluster_size);
+
+#endif // MANIFEST_H
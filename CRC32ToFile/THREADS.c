@@ -0,0 +1,298 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "THREADS.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+
+struct THREAD_START {
+    thread_worker_fn fn;
+    void *arg;
+    int index;
+};
+
+
+int threads_cpu_count(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    int count = (int)info.dwNumberOfProcessors;
+#else
+    int count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    if (count < 1) count = 1;
+    if (count > THREADS_MAX) count = THREADS_MAX;
+    return count;
+}
+
+
+#ifdef _WIN32
+static DWORD WINAPI threads_entry(LPVOID param) {
+    struct THREAD_START *start = (struct THREAD_START *)param;
+    start->fn(start->arg, start->index);
+    return 0;
+}
+#else
+static void *threads_entry(void *param) {
+    struct THREAD_START *start = (struct THREAD_START *)param;
+    start->fn(start->arg, start->index);
+    return NULL;
+}
+#endif
+
+
+int threads_run(int count, thread_worker_fn fn, void *arg) {
+    struct THREAD_START start[THREADS_MAX];
+#ifdef _WIN32
+    HANDLE handle[THREADS_MAX];
+#else
+    pthread_t handle[THREADS_MAX];
+#endif
+    int started = 0;
+
+    if (count > THREADS_MAX) count = THREADS_MAX;
+    if (count <= 1) {
+        fn(arg, 0);
+        return 1;
+    }
+
+    // Worker 0 is the calling thread
+    for (int i = 1; i < count; i++) {
+        start[i].fn = fn;
+        start[i].arg = arg;
+        start[i].index = i;
+#ifdef _WIN32
+        handle[i] = CreateThread(NULL, 0, threads_entry, &start[i], 0, NULL);
+        if (handle[i] == NULL) {
+#else
+        if (pthread_create(&handle[i], NULL, threads_entry, &start[i]) != 0) {
+#endif
+            fprintf(stderr, "Warning: could not start worker thread %d\n", i);
+            break;
+        }
+        started = i;
+    }
+
+    fn(arg, 0);
+
+    for (int i = 1; i <= started; i++) {
+#ifdef _WIN32
+        WaitForSingleObject(handle[i], INFINITE);
+        CloseHandle(handle[i]);
+#else
+        pthread_join(handle[i], NULL);
+#endif
+    }
+    return started + 1;
+}
+
+
+double threads_now(void) {
+#ifdef _WIN32
+    LARGE_INTEGER freq, count;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    return (double)count.QuadPart / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
+
+void threads_yield(void) {
+#ifdef _WIN32
+    Sleep(0);
+#else
+    sched_yield();
+#endif
+}
+
+
+/********************************************************************************************************************
+*********************************************************************************************************************
+*****************************************        WORK STEALING POOL        ******************************************
+*********************************************************************************************************************
+*********************************************************************************************************************/
+
+
+/* The tasks are whole files or ranges of a big file, thousands at most and each
+one a lot longer than taking a lock, so every deque is a growing array under
+its own lock rather than a lock free Chase-Lev deque. */
+
+struct THREAD_DEQUE {
+#ifdef _WIN32
+    CRITICAL_SECTION lock;
+#else
+    pthread_mutex_t lock;
+#endif
+    void **tasks;
+    int top;                    // Oldest task, thieves take it
+    int bottom;                 // One past the newest task, the owner takes it
+    int capacity;
+};
+
+struct THREAD_POOL {
+    thread_task_fn fn;
+    int count;
+    volatile int pending;       // Tasks pushed and not finished yet
+    struct THREAD_DEQUE deque[THREADS_MAX];
+};
+
+
+static void threads_lock(struct THREAD_DEQUE *deque) {
+#ifdef _WIN32
+    EnterCriticalSection(&deque->lock);
+#else
+    pthread_mutex_lock(&deque->lock);
+#endif
+}
+
+
+static void threads_unlock(struct THREAD_DEQUE *deque) {
+#ifdef _WIN32
+    LeaveCriticalSection(&deque->lock);
+#else
+    pthread_mutex_unlock(&deque->lock);
+#endif
+}
+
+
+struct THREAD_POOL *threads_pool_create(int count, thread_task_fn fn) {
+    struct THREAD_POOL *pool = (struct THREAD_POOL *)calloc(1, sizeof(struct THREAD_POOL));
+    if (pool == NULL) return NULL;
+
+    if (count < 1) count = 1;
+    if (count > THREADS_MAX) count = THREADS_MAX;
+    pool->fn = fn;
+    pool->count = count;
+    for (int i = 0; i < count; i++) {
+#ifdef _WIN32
+        InitializeCriticalSection(&pool->deque[i].lock);
+#else
+        pthread_mutex_init(&pool->deque[i].lock, NULL);
+#endif
+    }
+    return pool;
+}
+
+
+int threads_pool_push(struct THREAD_POOL *pool, int worker, void *task) {
+    struct THREAD_DEQUE *deque = &pool->deque[worker % pool->count];
+    int result = 0;
+
+    threads_lock(deque);
+    if (deque->bottom == deque->capacity) {
+        // Slide the live tasks back to the start before growing the array
+        int live = deque->bottom - deque->top;
+        if (deque->top > 0 && live < deque->capacity / 2) {
+            memmove(deque->tasks, deque->tasks + deque->top, live * sizeof(void *));
+        } else {
+            int capacity = deque->capacity ? deque->capacity * 2 : 64;
+            void **tasks = (void **)realloc(deque->tasks, capacity * sizeof(void *));
+            if (tasks == NULL) {
+                result = -1;
+            } else {
+                memmove(tasks, tasks + deque->top, live * sizeof(void *));
+                deque->tasks = tasks;
+                deque->capacity = capacity;
+            }
+        }
+        if (result == 0) {
+            deque->top = 0;
+            deque->bottom = live;
+        }
+    }
+    if (result == 0) {
+        deque->tasks[deque->bottom++] = task;
+        threads_fetch_add(&pool->pending, 1);
+    }
+    threads_unlock(deque);
+    return result;
+}
+
+
+// Newest task of the worker's own deque, or the oldest of another one
+static void *threads_pool_take(struct THREAD_POOL *pool, int worker) {
+    struct THREAD_DEQUE *deque = &pool->deque[worker];
+    void *task = NULL;
+
+    threads_lock(deque);
+    if (deque->bottom > deque->top) task = deque->tasks[--deque->bottom];
+    threads_unlock(deque);
+    if (task) return task;
+
+    for (int i = 1; i < pool->count && task == NULL; i++) {
+        deque = &pool->deque[(worker + i) % pool->count];
+        threads_lock(deque);
+        if (deque->bottom > deque->top) task = deque->tasks[deque->top++];
+        threads_unlock(deque);
+    }
+    return task;
+}
+
+
+static void threads_pool_worker(void *arg, int index) {
+    struct THREAD_POOL *pool = (struct THREAD_POOL *)arg;
+
+    // A task can push more tasks, so an empty round is only the end once
+    // no task is pending anywhere
+    while (pool->pending > 0) {
+        void *task = threads_pool_take(pool, index);
+        if (task == NULL) {
+            threads_yield();
+            continue;
+        }
+        pool->fn(pool, index, task);
+        threads_fetch_add(&pool->pending, -1);
+    }
+}
+
+
+void threads_pool_run(struct THREAD_POOL *pool) {
+    threads_run(pool->count, threads_pool_worker, pool);
+}
+
+
+int threads_pool_help(struct THREAD_POOL *pool, int worker) {
+    struct THREAD_DEQUE *deque = &pool->deque[worker];
+    void *task = NULL;
+
+    threads_lock(deque);
+    if (deque->bottom > deque->top) task = deque->tasks[--deque->bottom];
+    threads_unlock(deque);
+    if (task == NULL) return 0;
+
+    pool->fn(pool, worker, task);
+    threads_fetch_add(&pool->pending, -1);
+    return 1;
+}
+
+
+int threads_pool_count(const struct THREAD_POOL *pool) {
+    return pool->count;
+}
+
+
+void threads_pool_free(struct THREAD_POOL *pool) {
+    if (pool == NULL) return;
+    for (int i = 0; i < pool->count; i++) {
+#ifdef _WIN32
+        DeleteCriticalSection(&pool->deque[i].lock);
+#else
+        pthread_mutex_destroy(&pool->deque[i].lock);
+#endif
+        free(pool->deque[i].tasks);
+    }
+    free(pool);
+}
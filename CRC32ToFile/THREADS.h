@@ -0,0 +1,58 @@
+#ifndef __THREADS_H__
+#define __THREADS_H__
+
+#include <stdint.h>
+
+// Small wrapper over Win32 threads (Dev-C++ build) and pthreads (other hosts)
+
+#define THREADS_MAX 64
+
+// Worker function, index is 0..count-1
+typedef void (*thread_worker_fn)(void *arg, int index);
+
+int threads_cpu_count(void);
+
+// Start count workers running fn(arg, index) and wait for all of them.
+// Worker 0 is the calling thread, so with count <= 1 nothing is started.
+// Workers must pull their jobs from a shared counter: if a thread can not be
+// started the others still do all the work. Return how many workers ran.
+int threads_run(int count, thread_worker_fn fn, void *arg);
+
+// Atomic fetch and add, used by the workers to pick the next job
+#define threads_fetch_add(ptr, value) __sync_fetch_and_add((ptr), (value))
+
+// Wall clock in seconds
+double threads_now(void);
+
+// Give the rest of the time slice to another thread (idle workers of the pool)
+void threads_yield(void);
+
+
+// Work stealing pool: every worker has its own deque of tasks. A worker pushes
+// and pops at the bottom of its own deque (last pushed first, the data is still
+// in its cache) and when it is empty steals from the top of the others (the
+// oldest, usually biggest, tasks). Tasks may push more tasks while they run.
+struct THREAD_POOL;
+
+typedef void (*thread_task_fn)(struct THREAD_POOL *pool, int worker, void *task);
+
+// NULL if out of memory. count is capped to THREADS_MAX.
+struct THREAD_POOL *threads_pool_create(int count, thread_task_fn fn);
+
+// Queue a task on the deque of worker (any worker index before threads_pool_run,
+// the running worker from a task). Return 0 on success, -1 if out of memory.
+int threads_pool_push(struct THREAD_POOL *pool, int worker, void *task);
+
+// Run all the queued tasks, and the ones they push, on the workers and return
+// when there are none left
+void threads_pool_run(struct THREAD_POOL *pool);
+
+// From a task waiting on the tasks it pushed: run the newest task of the
+// worker's own deque. Return 1 if a task ran, 0 if the deque is empty. The
+// pushed tasks get done even when no other worker thread could be started.
+int threads_pool_help(struct THREAD_POOL *pool, int worker);
+
+int threads_pool_count(const struct THREAD_POOL *pool);
+void threads_pool_free(struct THREAD_POOL *pool);
+
+#endif // THREADS_H
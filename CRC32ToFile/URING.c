@@ -0,0 +1,385 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "CRC32.h"
+#include "URING.h"
+
+#ifdef __linux__
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
+
+#ifndef __linux__
+
+int uring_available(void) {
+    return 0;
+}
+
+
+int uring_run(struct BATCH_FILE **files, int count, struct THREAD_POOL *pool, int worker) {
+    (void)files;
+    (void)count;
+    (void)pool;
+    (void)worker;
+    return -1;
+}
+
+#else // __linux__
+
+
+/* The ring is set up with the raw system calls, there is no liburing on the
+build machines. Each file goes through the stages below, one request in
+flight per file at a time, and the requests of all the files are submitted
+together on each turn of the loop:
+   OPEN -> READ (size + 1 bytes, to see a file that changed since the walk)
+        -> CRC on a worker -> WRITE of the trailer at offset size -> CLOSE
+   With --verify the last 8 bytes of the read are kept aside and the trailer
+   is checked instead of written. */
+
+enum { URING_FREE, URING_OPEN, URING_READ, URING_CRC, URING_WRITE, URING_CLOSE };
+
+struct URING_SLOT {
+    struct BATCH_FILE *file;
+    struct BATCH_TASK task;         // BATCH_TASK_BUFFER, queued when the data is read
+    int stage;
+    int fd;
+    uint8_t *buffer;
+    size_t capacity;
+    char trailer[9];
+    uint32_t length;                // Of the trailer, 8 text or 4 binary
+};
+
+struct URING {
+    int fd;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ring, *cq_ring;
+    size_t sq_size, cq_size, sqes_size;
+    unsigned queued;                // SQEs written, not yet submitted
+};
+
+
+static int uring_setup(unsigned entries, struct io_uring_params *params) {
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+
+static int uring_enter(int fd, unsigned submit, unsigned wait) {
+    return (int)syscall(__NR_io_uring_enter, fd, submit, wait,
+                        wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+}
+
+
+static void uring_close(struct URING *ring) {
+    if (ring->sqes) munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ring && ring->cq_ring != ring->sq_ring) munmap(ring->cq_ring, ring->cq_size);
+    if (ring->sq_ring) munmap(ring->sq_ring, ring->sq_size);
+    if (ring->fd >= 0) close(ring->fd);
+}
+
+
+static int uring_open(struct URING *ring, unsigned entries) {
+    struct io_uring_params params;
+
+    memset(ring, 0, sizeof(*ring));
+    memset(&params, 0, sizeof(params));
+    ring->fd = uring_setup(entries, &params);
+    if (ring->fd < 0) return -1;
+
+    // FAST_POLL came with 5.7, after the OPENAT and CLOSE opcodes (5.6)
+    if (!(params.features & IORING_FEAT_FAST_POLL)) {
+        uring_close(ring);
+        return -1;
+    }
+
+    ring->sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_size > ring->sq_size) ring->sq_size = ring->cq_size;
+        ring->cq_size = ring->sq_size;
+    }
+
+    ring->sq_ring = mmap(NULL, ring->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED) {
+        ring->sq_ring = NULL;
+        uring_close(ring);
+        return -1;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_ring = ring->sq_ring;
+    } else {
+        ring->cq_ring = mmap(NULL, ring->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                             ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ring == MAP_FAILED) {
+            ring->cq_ring = NULL;
+            uring_close(ring);
+            return -1;
+        }
+    }
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = (struct io_uring_sqe *)mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+                                             MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        ring->sqes = NULL;
+        uring_close(ring);
+        return -1;
+    }
+
+    uint8_t *sq = (uint8_t *)ring->sq_ring;
+    uint8_t *cq = (uint8_t *)ring->cq_ring;
+    ring->sq_head  = (unsigned *)(sq + params.sq_off.head);
+    ring->sq_tail  = (unsigned *)(sq + params.sq_off.tail);
+    ring->sq_mask  = (unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+    ring->cq_head  = (unsigned *)(cq + params.cq_off.head);
+    ring->cq_tail  = (unsigned *)(cq + params.cq_off.tail);
+    ring->cq_mask  = (unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes     = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    return 0;
+}
+
+
+// Next free SQE, published to the kernel by uring_submit. There is at most
+// one request per slot in flight, the ring has room for all of them.
+static struct io_uring_sqe *uring_sqe(struct URING *ring, int slot, int opcode, int fd) {
+    unsigned tail = *ring->sq_tail + ring->queued;
+    unsigned index = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = (uint8_t)opcode;
+    sqe->fd = fd;
+    sqe->user_data = (uint64_t)slot;
+    ring->sq_array[index] = index;
+    ring->queued++;
+    return sqe;
+}
+
+
+static int uring_submit(struct URING *ring, unsigned wait) {
+    unsigned submit = ring->queued;
+
+    __atomic_store_n(ring->sq_tail, *ring->sq_tail + submit, __ATOMIC_RELEASE);
+    ring->queued = 0;
+    if (submit == 0 && wait == 0) return 0;
+
+    int result;
+    do {
+        result = uring_enter(ring->fd, submit, wait);
+    } while (result < 0 && errno == EINTR);
+    return result < 0 ? -1 : 0;
+}
+
+
+int uring_available(void) {
+    static int available = -1;
+    struct URING ring;
+
+    if (available < 0) {
+        available = (uring_open(&ring, 4) == 0);
+        if (available) uring_close(&ring);
+    }
+    return available;
+}
+
+
+static void uring_read(struct URING *ring, struct URING_SLOT *slot, int index) {
+    size_t want = (size_t)slot->file->listed_size + 1;
+
+    if (slot->capacity < want) {
+        uint8_t *buffer = (uint8_t *)realloc(slot->buffer, want);
+        if (buffer == NULL) {
+            fprintf(stderr, "%s: out of memory\n", slot->file->path);
+            slot->file->error = 1;
+            slot->stage = URING_CLOSE;
+            uring_sqe(ring, index, IORING_OP_CLOSE, slot->fd);
+            return;
+        }
+        slot->buffer = buffer;
+        slot->capacity = want;
+    }
+
+    struct io_uring_sqe *sqe = uring_sqe(ring, index, IORING_OP_READ, slot->fd);
+    sqe->addr = (uint64_t)(uintptr_t)slot->buffer;
+    sqe->len = (uint32_t)want;
+    sqe->off = 0;
+    slot->stage = URING_READ;
+}
+
+
+// Trailer, or straight to close when there is nothing to write
+static void uring_write(struct URING *ring, struct URING_SLOT *slot, int index) {
+    struct BATCH_FILE *file = slot->file;
+
+    if (file->flags & BATCH_VERIFY) batch_check(file);
+    if (file->error || (file->flags & BATCH_NO_WRITE)) {
+        slot->stage = URING_CLOSE;
+        uring_sqe(ring, index, IORING_OP_CLOSE, slot->fd);
+        return;
+    }
+
+    if (file->flags & BATCH_BINARY) {
+        crc32_model_store(file->model, file->crc, (uint8_t *)slot->trailer);
+        slot->length = 4;
+    } else {
+        snprintf(slot->trailer, sizeof(slot->trailer), "%08X", file->crc);
+        slot->length = 8;
+    }
+    struct io_uring_sqe *sqe = uring_sqe(ring, index, IORING_OP_WRITE, slot->fd);
+    sqe->addr = (uint64_t)(uintptr_t)slot->trailer;
+    sqe->len = slot->length;
+    sqe->off = file->size;
+    slot->stage = URING_WRITE;
+}
+
+
+// Result of the request of a slot, queue its next one
+static void uring_complete(struct URING *ring, struct URING_SLOT *slots, int index, int result,
+                           struct THREAD_POOL *pool, int worker, int *active) {
+    struct URING_SLOT *slot = &slots[index];
+    struct BATCH_FILE *file = slot->file;
+
+    switch (slot->stage) {
+        case URING_OPEN:
+            if (result < 0) {
+                fprintf(stderr, "%s: %s\n", file->path, strerror(-result));
+                file->error = 1;
+                slot->stage = URING_FREE;
+                (*active)--;
+                break;
+            }
+            slot->fd = result;
+            uring_read(ring, slot, index);
+            break;
+
+        case URING_READ:
+            if (result < 0 || (uint64_t)result != file->listed_size) {
+                fprintf(stderr, "%s: %s\n", file->path,
+                        (result < 0) ? strerror(-result) : "size changed while reading");
+                file->error = 1;
+                slot->stage = URING_CLOSE;
+                uring_sqe(ring, index, IORING_OP_CLOSE, slot->fd);
+                break;
+            }
+            file->size = file->listed_size;
+            if (file->flags & BATCH_VERIFY) {
+                batch_split_trailer(file, slot->buffer + file->size, file->size);
+            }
+            file->map = slot->buffer;
+            file->ready = 0;
+            slot->stage = URING_CRC;
+            slot->task.file = file;
+            slot->task.range = BATCH_TASK_BUFFER;
+            if (threads_pool_count(pool) == 1 || threads_pool_push(pool, worker, &slot->task) != 0) {
+                file->crc = crc32_model_compute(file->model, slot->buffer, (size_t)file->size);
+                file->ready = 1;
+            }
+            break;
+
+        case URING_WRITE:
+            if (result != (int)slot->length) {
+                fprintf(stderr, "%s: %s\n", file->path,
+                        (result < 0) ? strerror(-result) : "short write of the trailer");
+                file->error = 1;
+            }
+            slot->stage = URING_CLOSE;
+            uring_sqe(ring, index, IORING_OP_CLOSE, slot->fd);
+            break;
+
+        case URING_CLOSE:
+            file->map = NULL;
+            slot->stage = URING_FREE;
+            (*active)--;
+            break;
+    }
+}
+
+
+int uring_run(struct BATCH_FILE **files, int count, struct THREAD_POOL *pool, int worker) {
+    struct URING ring;
+    struct URING_SLOT slots[URING_DEPTH];
+    int next = 0, active = 0, result = 0;
+
+    if (uring_open(&ring, URING_DEPTH) != 0) return -1;
+    memset(slots, 0, sizeof(slots));
+
+    while (next < count || active > 0) {
+        int in_flight = 0, computing = 0;
+
+        for (int i = 0; i < URING_DEPTH; i++) {
+            struct URING_SLOT *slot = &slots[i];
+
+            // Start the next file on a free slot
+            if (slot->stage == URING_FREE && next < count) {
+                slot->file = files[next++];
+                int flags = (slot->file->flags & BATCH_NO_WRITE) ? O_RDONLY : O_RDWR;
+                struct io_uring_sqe *sqe = uring_sqe(&ring, i, IORING_OP_OPENAT, AT_FDCWD);
+                sqe->addr = (uint64_t)(uintptr_t)slot->file->path;
+                sqe->open_flags = flags | O_CLOEXEC;
+                slot->stage = URING_OPEN;
+                active++;
+            }
+
+            // The trailers of all the CRCs finished since the last turn go out together
+            if (slot->stage == URING_CRC) {
+                if (__atomic_load_n(&slot->file->ready, __ATOMIC_ACQUIRE)) {
+                    uring_write(&ring, slot, i);
+                } else {
+                    computing++;
+                }
+            }
+            if (slot->stage != URING_FREE && slot->stage != URING_CRC) in_flight++;
+        }
+
+        // Wait for a completion only when no CRC can finish in the meantime
+        if (uring_submit(&ring, (in_flight > 0 && computing == 0) ? 1 : 0) != 0) {
+            perror("io_uring_enter");
+            result = -1;
+            break;
+        }
+
+        // Nothing completed: run a queued CRC here rather than wait for a
+        // worker to take it, there may be none if their threads did not start
+        unsigned head = *ring.cq_head;
+        unsigned tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+        if (head == tail && computing > 0 && threads_pool_help(pool, worker) == 0) threads_yield();
+        while (head != tail) {
+            struct io_uring_cqe *cqe = &ring.cqes[head & *ring.cq_mask];
+            uring_complete(&ring, slots, (int)cqe->user_data, cqe->res, pool, worker, &active);
+            head++;
+        }
+        __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    // Only after a failed io_uring_enter: the files not done are reported as errors
+    if (result != 0) {
+        for (int i = 0; i < URING_DEPTH; i++) {
+            if (slots[i].stage == URING_CRC) {
+                while (!__atomic_load_n(&slots[i].file->ready, __ATOMIC_ACQUIRE)) {
+                    if (threads_pool_help(pool, worker) == 0) threads_yield();
+                }
+            }
+            if (slots[i].stage != URING_FREE) {
+                slots[i].file->error = 1;
+                slots[i].file->map = NULL;
+            }
+        }
+        for (; next < count; next++) files[next]->error = 1;
+    }
+
+    for (int i = 0; i < URING_DEPTH; i++) free(slots[i].buffer);
+    uring_close(&ring);
+    return 0;
+}
+
+#endif // __linux__
@@ -0,0 +1,27 @@
+#ifndef __URING_H__
+#define __URING_H__
+
+#include "FILECRC.h"
+#include "THREADS.h"
+#include "BATCH.h"
+
+// io_uring backend of the batch mode, Linux only. The small files are opened,
+// read, stamped and closed through one ring with up to URING_DEPTH files in
+// flight, so thousands of files cost a few io_uring_enter calls instead of an
+// open/read/seek/write/close each. Their CRCs are computed by the workers.
+
+#define URING_DEPTH 64                      // Files in flight
+
+// Bigger files are mapped (FILECRC_MMAP_MIN) on the blocking path
+#define URING_MAX_SIZE FILECRC_MMAP_MIN
+
+// 1 if the kernel has io_uring with openat and close (Linux 5.7 and later),
+// 0 on other systems and when it is disabled
+int uring_available(void);
+
+// CRC, and without BATCH_NO_WRITE stamp, the files from a task running on
+// worker of pool. The CRCs are queued as BATCH_TASK_BUFFER tasks for the other
+// workers, and run by this one while it waits for them. Return -1 (with nothing done) if the ring can not be set up.
+int uring_run(struct BATCH_FILE **files, int count, struct THREAD_POOL *pool, int worker);
+
+#endif // URING_H
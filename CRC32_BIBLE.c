@@ -5,6 +5,9 @@ anything useful. More comments are at the bottom of this file. */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#include "CRC32/CRC32.h"    // Length based engines, build with: gcc CRC32_BIBLE.c CRC32/CRC32.c
 
 // ---------------------------- reverse --------------------------------
 
@@ -657,6 +660,10 @@ unsigned int crc32h(unsigned char *message) {
 
 // ------------------------------ main ---------------------------------
 
+// CRC32BibleBench compiles this file with -DCRC32_BIBLE_NO_MAIN to time the
+// routines above, it has its own main.
+#ifndef CRC32_BIBLE_NO_MAIN
+
 int main(int argc, char ** argv) {
 
    if (argc != 2) {
@@ -680,9 +687,48 @@ int main(int argc, char ** argv) {
    // halfword function with an odd starting address.
    printf("\ncrc32d = %08x\n", crc32d(argv[1] + 1));
    printf("crc32a = %08x\n", crc32a(argv[1] + 1));
-   return 0;
+
+   // The length based engines used by CRC32ToFile must give the same
+   // result as every routine above (crc32cx only when the length is a
+   // multiple of 4).
+   unsigned char *msg = (unsigned char *)argv[1];
+   unsigned int ref[8] = {crc32a(msg), crc32b(msg), crc32c(msg), crc32d(msg),
+                          crc32e(msg), crc32f(msg), crc32g(msg), crc32h(msg)};
+   size_t len = strlen(argv[1]);
+   int errors = 0, bad, engine, k;
+
+   printf("\n");
+   for (engine = 0; engine < CRC32_ENGINE_COUNT; engine++) {
+      crc32_select_engine(engine);
+      bad = 0;
+      for (k = 0; k <= 1; k++) {            // Whole message, then from an odd address.
+         unsigned int crc = crc32_compute(msg + k, len - k);
+         if (k == 0) printf("%-8s= %08x", crc32_engine_name(engine), crc);
+         if (crc != crc32b(msg + k) || crc != crc32d(msg + k) || crc != crc32a(msg + k)) bad++;
+      }
+      for (k = 0; k < 8; k++) {
+         if (ref[k] != crc32_compute(msg, len)) bad++;
+      }
+      printf("%s\n", bad ? "  MISMATCH" : "  ok");
+      errors += bad;
+   }
+
+   // The models in CRC32_MODELS.h against their check value (CRC of "123456789"),
+   // crc32_model_ieee must also agree with crc32b.
+   printf("\n");
+   for (k = 0; crc32_models[k] != NULL; k++) {
+      const struct crc32_model *model = crc32_models[k];
+      unsigned int crc = crc32_model_compute(model, msg, len);
+      bad = crc32_model_compute(model, "123456789", 9) != model->check;
+      if (model == &crc32_model_ieee && crc != crc32b(msg)) bad++;
+      printf("%-11s= %08x%s\n", model->name, crc, bad ? "  MISMATCH" : "  ok");
+      errors += bad;
+   }
+   return errors != 0;
 }
 
+#endif // CRC32_BIBLE_NO_MAIN
+
 /* The code above computes, in several ways, the cyclic redundancy check
 usually referred to as CRC-32. This code is used by IEEE-802 (LAN/MAN
 standard), PKZip, WinZip, Ethernet, and some DOD applications.
@@ -0,0 +1,375 @@
+/*
+    Cluster chain walking of the FAT12 library.
+
+    Times following every chain of an image with get_next_cluster decoding
+    the packed 12-bit FAT on each call, and with the FAT decoded once
+    (fat12_decode_fat), in ns per cluster.
+
+    FAT12Bench                  synthetic images: contiguous, interleaved and shuffled files
+    FAT12Bench <image>...       the files of the root directory of each image
+
+    With --scan it times instead the lookup of a name in a full 512 entry
+    root directory: formatting every entry to "NAME.EXT" and strcmp (the
+    first version of load_file_to_buffer), and the raw 11 byte compare of
+    fat12_scan_name, scalar and SSE2.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include "FAT12.h"
+
+#define MIN_TIME       0.05     // Seconds spent on each measurement
+#define SECTOR         4096     // Geometry of the 25Q32 images: 4 KB sectors, one per cluster
+#define FAT_SECTORS    2
+#define SYNTH_CLUSTERS 4000     // Data clusters of the synthetic images
+#define SYNTH_FILES    8
+#define MAX_FILES      256
+#define SCAN_ENTRIES   512      // Biggest FAT12 root directory
+
+// Needed by the FAT12 library
+uint8_t NO_OF_FILES = 0;
+struct FILE_ENTRY FILES[20];
+
+struct FAT12_FAT decodedFat;
+
+// One image to walk: its boot sector and FAT, and the first cluster of each file
+struct CHAINS {
+    const char *name;
+    char *head;
+    struct BPB bpb;
+    uint16_t start[MAX_FILES];
+    int files;
+};
+
+
+// Wall clock in seconds
+static double bench_now(void) {
+#ifdef _WIN32
+    LARGE_INTEGER freq, count;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    return (double)count.QuadPart / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
+
+// Follow every chain, return the sum of the clusters (the same whatever the decoder)
+static uint32_t walk_chains(const struct CHAINS *chains, uint32_t *links) {
+    uint32_t sum = 0;
+
+    *links = 0;
+    for (int i = 0; i < chains->files; i++) {
+        uint32_t cluster = chains->start[i];
+        for (uint32_t steps = 0; cluster >= 2 && cluster < 0xFF8 && steps < FAT12_MAX_CLUSTERS; steps++) {
+            sum += cluster;
+            (*links)++;
+            cluster = get_next_cluster(&chains->bpb, (uint16_t)cluster, chains->head);
+        }
+    }
+    return sum;
+}
+
+
+// Repeat the walk until MIN_TIME is spent, return ns per cluster
+static double bench_walk(const struct CHAINS *chains, uint32_t *sum) {
+    volatile uint32_t sink = 0;
+    uint32_t rounds = 0, links;
+    double start, elapsed;
+
+    *sum = walk_chains(chains, &links);     // Warm up
+    start = bench_now();
+    do {
+        sink ^= walk_chains(chains, &links);
+        rounds++;
+        elapsed = bench_now() - start;
+    } while (elapsed < MIN_TIME);
+
+    (void)sink;
+    return (links ? elapsed * 1e9 / ((double)links * rounds) : 0);
+}
+
+
+static int bench_chains(const struct CHAINS *chains) {
+    uint32_t packed_sum, decoded_sum, links;
+    volatile uint32_t sink = 0;
+    uint32_t rounds = 0;
+    double start, elapsed;
+
+    fat12_fat = NULL;
+    double packed = bench_walk(chains, &packed_sum);
+
+    start = bench_now();
+    do {
+        sink ^= fat12_decode_fat(&decodedFat, &chains->bpb, chains->head);
+        rounds++;
+        elapsed = bench_now() - start;
+    } while (elapsed < MIN_TIME);
+    (void)sink;
+    double decode = elapsed * 1e6 / rounds;
+
+    fat12_fat = &decodedFat;
+    double decoded = bench_walk(chains, &decoded_sum);
+    fat12_fat = NULL;
+
+    walk_chains(chains, &links);
+    printf("%-24s %6u %10.2f %10.2f %8.2fx %10.2f%s\n", chains->name, links, packed, decoded,
+           decoded > 0 ? packed / decoded : 0, decode, packed_sum != decoded_sum ? "  MISMATCH" : "");
+    return packed_sum != decoded_sum;
+}
+
+
+/************************************************************************************
+ * Synthetic images
+ ************************************************************************************/
+
+static void fat_set(char *head, uint16_t cluster, uint16_t value) {
+    uint8_t *p = (uint8_t *)head + SECTOR + cluster * 3 / 2;
+
+    if (cluster & 1) {
+        p[0] = (uint8_t)((p[0] & 0x0F) | (value << 4));
+        p[1] = (uint8_t)(value >> 4);
+    } else {
+        p[0] = (uint8_t)value;
+        p[1] = (uint8_t)((p[1] & 0xF0) | ((value >> 8) & 0x0F));
+    }
+}
+
+
+// order lists the data clusters, file f gets every SYNTH_FILES-th of them from f
+static void synth_image(struct CHAINS *chains, const char *name, const uint16_t *order) {
+    memset(chains->head, 0, SECTOR * (1 + FAT_SECTORS));
+    chains->name = name;
+    chains->files = SYNTH_FILES;
+
+    for (int f = 0; f < SYNTH_FILES; f++) {
+        chains->start[f] = order[f];
+        for (int i = f; i < SYNTH_CLUSTERS; i += SYNTH_FILES) {
+            fat_set(chains->head, order[i], (i + SYNTH_FILES < SYNTH_CLUSTERS) ? order[i + SYNTH_FILES] : 0xFFF);
+        }
+    }
+}
+
+
+static int bench_synthetic(void) {
+    static uint16_t order[SYNTH_CLUSTERS];
+    struct CHAINS chains;
+    int errors = 0;
+
+    memset(&chains, 0, sizeof(chains));
+    chains.head = (char *)malloc(SECTOR * (1 + FAT_SECTORS));
+    if (chains.head == NULL) {
+        perror("Memory allocation for the image failed");
+        return 1;
+    }
+    chains.bpb.bytes_per_sector = SECTOR;
+    chains.bpb.sectors_per_cluster = 1;
+    chains.bpb.reserved_sectors = 1;
+    chains.bpb.num_fats = 1;
+    chains.bpb.sectors_per_fat = FAT_SECTORS;
+    chains.bpb.geometry = fat12_geometry(&chains.bpb);
+
+    // Each file in one run of clusters
+    for (int f = 0, i = 0; f < SYNTH_FILES; f++) {
+        for (int k = f; k < SYNTH_CLUSTERS; k += SYNTH_FILES) order[k] = (uint16_t)(2 + i++);
+    }
+    synth_image(&chains, "contiguous", order);
+    errors += bench_chains(&chains);
+
+    // Files written together, their clusters alternate
+    for (int i = 0; i < SYNTH_CLUSTERS; i++) order[i] = (uint16_t)(2 + i);
+    synth_image(&chains, "interleaved", order);
+    errors += bench_chains(&chains);
+
+    // Free clusters scattered by deletes
+    srand(12);
+    for (int i = SYNTH_CLUSTERS - 1; i > 0; i--) {
+        int j = rand() % (i + 1);
+        uint16_t t = order[i];
+        order[i] = order[j];
+        order[j] = t;
+    }
+    synth_image(&chains, "shuffled", order);
+    errors += bench_chains(&chains);
+
+    free(chains.head);
+    return errors;
+}
+
+
+/************************************************************************************
+ * Images
+ ************************************************************************************/
+
+static int bench_image(const char *path) {
+    struct CHAINS chains;
+    char boot[512];
+
+    memset(&chains, 0, sizeof(chains));
+    chains.name = path;
+
+    FILE *file = fopen(path, "rb");
+    if (file == NULL || fread(boot, 1, sizeof(boot), file) != sizeof(boot)) {
+        perror(path);
+        if (file) fclose(file);
+        return 1;
+    }
+    // load_bpb divides by the sector size, check it and the cluster size first
+    if ((boot[11] == 0 && boot[12] == 0) || boot[13] == 0) {
+        fprintf(stderr, "%s: not a FAT12 image\n", path);
+        fclose(file);
+        return 1;
+    }
+    load_bpb(&chains.bpb, boot);
+
+    // Boot sector, FATs and root directory
+    size_t head_size = (size_t)chains.bpb.data_start_sector * chains.bpb.bytes_per_sector;
+    chains.head = (char *)calloc(1, head_size);
+    if (chains.head == NULL || fseek(file, 0, SEEK_SET) != 0 || fread(chains.head, 1, head_size, file) != head_size) {
+        fprintf(stderr, "%s: cannot read the system area\n", path);
+        free(chains.head);
+        fclose(file);
+        return 1;
+    }
+    fclose(file);
+
+    struct FILE_ENTRY *files = (struct FILE_ENTRY *)calloc(chains.bpb.root_dir_entries + 1, sizeof(struct FILE_ENTRY));
+    if (files == NULL) {
+        perror("Memory allocation for the file list failed");
+        free(chains.head);
+        return 1;
+    }
+    uint8_t count = get_files(&chains.bpb, chains.head, files);
+    for (int i = 0; i < count && chains.files < MAX_FILES; i++) {
+        if (files[i].size > 0) chains.start[chains.files++] = files[i].cluster;
+    }
+    free(files);
+
+    int errors = bench_chains(&chains);
+    free(chains.head);
+    return errors;
+}
+
+
+/************************************************************************************
+ * Root directory scan
+ ************************************************************************************/
+
+typedef int (*scan_fn)(const char *dir, uint16_t entries, const char *name);
+
+
+// The first version: every entry formatted to "NAME.EXT", then strcmp
+static int scan_formatted(const char *dir, uint16_t entries, const char *filename_to_find) {
+    for (uint16_t i = 0; i < entries; i++) {
+        const char *entry = dir + i * FAT12_ENTRY_SIZE;
+
+        if (entry[0] == 0x00) break;
+        if ((uint8_t)entry[0] == 0xE5 || (entry[11] & 0x08)) continue;
+
+        char filename[9] = {0};
+        char ext[4] = {0};
+        strncpy(filename, entry, 8);
+        strncpy(ext, entry + 8, 3);
+        for (int j = 7; j >= 0 && filename[j] == ' '; j--) filename[j] = '\0';
+        for (int j = 2; j >= 0 && ext[j] == ' '; j--) ext[j] = '\0';
+
+        char full_filename[FAT12_FILENAME_LENGTH + 2] = {0};
+        snprintf(full_filename, sizeof(full_filename), "%.8s.%.3s", filename, ext);
+        if (strcmp(full_filename, filename_to_find) == 0) return i;
+    }
+    return -1;
+}
+
+
+// Repeat the scan until MIN_TIME is spent, return ns per scan
+static double bench_scan(scan_fn fn, const char *dir, const char *name, int *found) {
+    volatile int sink = 0;
+    uint32_t rounds = 0;
+    double start, elapsed;
+
+    *found = fn(dir, SCAN_ENTRIES, name);
+    start = bench_now();
+    do {
+        sink ^= fn(dir, SCAN_ENTRIES, name);
+        rounds++;
+        elapsed = bench_now() - start;
+    } while (elapsed < MIN_TIME);
+
+    (void)sink;
+    return elapsed * 1e9 / rounds;
+}
+
+
+// Volume label, then files with every 7th deleted and every 5th behind a long
+// name part, the last entry is the file looked up
+static int bench_dir(void) {
+    static char dir[SCAN_ENTRIES * FAT12_ENTRY_SIZE];
+    const char *queries[2] = { "F0000511.TXT", "MISSING.TXT" };
+    char raw[FAT12_FILENAME_LENGTH];
+    int errors = 0;
+
+    memset(dir, 0, sizeof(dir));
+    memcpy(dir, "25Q32FLASH ", FAT12_FILENAME_LENGTH);
+    dir[11] = 0x08;
+    for (int i = 1; i < SCAN_ENTRIES; i++) {
+        char *entry = dir + i * FAT12_ENTRY_SIZE;
+        char name[FAT12_FILENAME_LENGTH + 1];
+
+        snprintf(name, sizeof(name), "F%07dTXT", i);
+        memcpy(entry, name, FAT12_FILENAME_LENGTH);
+        entry[11] = 0x20;
+        if (i % 5 == 0 && i != SCAN_ENTRIES - 1) entry[11] = 0x0F;
+        if (i % 7 == 0 && i != SCAN_ENTRIES - 1) entry[0] = (char)0xE5;
+    }
+
+    printf("%-14s %-10s %10s %12s\n", "Query", "Scan", "ns", "ns/entry");
+    for (int q = 0; q < 2; q++) {
+        int found, expected;
+        double ns = bench_scan(scan_formatted, dir, queries[q], &expected);
+        printf("%-14s %-10s %10.1f %12.2f\n", queries[q], "formatted", ns, ns / SCAN_ENTRIES);
+
+        if (fat12_raw_name(queries[q], raw) != 0) return 1;
+        ns = bench_scan(fat12_scan_name_scalar, dir, raw, &found);
+        printf("%-14s %-10s %10.1f %12.2f%s\n", queries[q], "scalar", ns, ns / SCAN_ENTRIES,
+               found != expected ? "  MISMATCH" : "");
+        errors += found != expected;
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+        if (__builtin_cpu_supports("sse2")) {
+            ns = bench_scan(fat12_scan_name_sse2, dir, raw, &found);
+            printf("%-14s %-10s %10.1f %12.2f%s\n", queries[q], "sse2", ns, ns / SCAN_ENTRIES,
+                   found != expected ? "  MISMATCH" : "");
+            errors += found != expected;
+        }
+#endif
+    }
+    return errors;
+}
+
+
+int main(int argc, char *argv[]) {
+    int errors = 0;
+
+    fat12_trace = 0;
+
+    if (argc == 2 && strcmp(argv[1], "--scan") == 0) return bench_dir() != 0;
+
+    printf("%-24s %6s %10s %10s %9s %10s\n", "Image", "Links", "Packed ns", "Decoded ns", "Speedup", "Decode us");
+    if (argc < 2) {
+        errors = bench_synthetic();
+    } else {
+        for (int i = 1; i < argc; i++) errors += bench_image(argv[i]);
+    }
+    return errors != 0;
+}
@@ -0,0 +1,399 @@
+/*
+    CRC-32 Merkle tree of a FAT12 image (25Q32 flash dump), see MERKLE.h.
+
+    FAT12Merkle <image>                       hash every sector, save <image>.MRK
+    FAT12Merkle --dirty=S[-S][,...] <image>   rehash only these sectors of the saved tree
+    FAT12Merkle --verify <image>              rehash everything, list what changed since the saved tree
+    FAT12Merkle --diff <imageA> <imageB>      sectors (and files) that differ, from the trees
+*/
+
+#define _FILE_OFFSET_BITS 64
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "CRC32.h"
+#include "FAT12.h"
+#include "MERKLE.h"
+
+#ifdef _WIN32
+#define file_seek64 _fseeki64
+#else
+#define file_seek64 fseeko
+#endif
+
+#define USAGE "<image>\n" \
+              "       %s --dirty=S[-S][,...] <image>\n" \
+              "       %s --verify <image>\n" \
+              "       %s --diff <imageA> <imageB>"
+
+// Needed by the FAT12 library
+uint8_t NO_OF_FILES = 0;
+struct FILE_ENTRY FILES[20];
+
+
+// An image, with its system area (boot sector, FATs, root directory) in memory
+struct IMAGE {
+    const char *path;
+    FILE *file;
+    uint64_t size;
+    int64_t mtime;
+    struct BPB bpb;
+    char *head;                     // The first data_start_sector sectors
+    char *tree_path;
+};
+
+
+static void image_close(struct IMAGE *image) {
+    if (image->file) fclose(image->file);
+    free(image->head);
+    free(image->tree_path);
+    memset(image, 0, sizeof(*image));
+}
+
+
+static int image_open(struct IMAGE *image, const char *path) {
+    char boot[512];
+    struct stat info;
+
+    memset(image, 0, sizeof(*image));
+    image->path = path;
+    image->file = fopen(path, "rb");
+    if (image->file == NULL || stat(path, &info) != 0) {
+        perror(path);
+        image_close(image);
+        return -1;
+    }
+    image->size = (uint64_t)info.st_size;
+    image->mtime = (int64_t)info.st_mtime;
+
+    // load_bpb divides by the sector size, check it and the cluster size first
+    if (fread(boot, 1, sizeof(boot), image->file) != sizeof(boot) ||
+        (boot[11] == 0 && boot[12] == 0) || boot[13] == 0) {
+        fprintf(stderr, "%s: not a FAT12 image\n", path);
+        image_close(image);
+        return -1;
+    }
+    load_bpb(&image->bpb, boot);
+
+    size_t head_size = (size_t)image->bpb.data_start_sector * image->bpb.bytes_per_sector;
+    image->head = (char *)calloc(1, head_size);
+    image->tree_path = (char *)malloc(strlen(path) + sizeof(MERKLE_SUFFIX));
+    if (image->head == NULL || image->tree_path == NULL) {
+        perror("Memory allocation for the image failed");
+        image_close(image);
+        return -1;
+    }
+    rewind(image->file);
+    if (fread(image->head, 1, head_size, image->file) != head_size) {
+        fprintf(stderr, "%s: shorter than its system area\n", path);
+        image_close(image);
+        return -1;
+    }
+    sprintf(image->tree_path, "%s" MERKLE_SUFFIX, path);
+    return 0;
+}
+
+
+static int image_read_sector(struct IMAGE *image, uint32_t sector, uint8_t *data) {
+    uint32_t size = image->bpb.bytes_per_sector;
+
+    if (file_seek64(image->file, (int64_t)sector * size, SEEK_SET) != 0 || fread(data, 1, size, image->file) != size) {
+        fprintf(stderr, "%s: can not read sector %u\n", image->path, sector);
+        return -1;
+    }
+    return 0;
+}
+
+
+// Every sector, read in order
+static int image_hash(struct IMAGE *image, struct MERKLE_TREE *tree) {
+    if (merkle_init(tree, &image->bpb, image->size) != 0) {
+        perror("Memory allocation for the tree failed");
+        return -1;
+    }
+
+    uint8_t *sector = (uint8_t *)malloc(tree->sector_size);
+    int result = (sector == NULL) ? -1 : 0;
+    rewind(image->file);
+    for (uint32_t s = 0; s < tree->sectors; s++) {
+        if (fread(sector, 1, tree->sector_size, image->file) != tree->sector_size) {
+            fprintf(stderr, "%s: can not read sector %u\n", image->path, s);
+            result = -1;
+            break;
+        }
+        merkle_set_leaf(tree, s, sector);
+    }
+    merkle_update(tree);
+    free(sector);
+    if (result != 0) merkle_free(tree);
+    return result;
+}
+
+
+// The saved tree if it was made from this very image, else every sector
+static int image_tree(struct IMAGE *image, struct MERKLE_TREE *tree, int *saved) {
+    uint64_t size;
+    int64_t mtime;
+
+    *saved = 0;
+    if (merkle_load(tree, image->tree_path, &size, &mtime) == 0) {
+        if (size == image->size && mtime == image->mtime) {
+            *saved = 1;
+            return 0;
+        }
+        merkle_free(tree);
+    }
+    return image_hash(image, tree);
+}
+
+
+static void print_roots(const struct MERKLE_TREE *tree) {
+    for (int r = 0; r < MERKLE_REGIONS; r++) {
+        if (tree->height[r] == 0) {
+            printf("  %-15s (empty)\n", merkle_region_names[r]);
+            continue;
+        }
+        printf("  %-15s sectors %5u-%-5u 0x%08X\n", merkle_region_names[r], tree->region[r],
+               tree->region[r + 1] - 1, merkle_region_root(tree, r));
+    }
+    printf("  %-15s %19s 0x%08X\n", "image", "", tree->root);
+}
+
+
+/************************************************************************************
+ * Owners of the data sectors, from the root directory and the FAT chains
+ ************************************************************************************/
+
+struct OWNERS {
+    const struct IMAGE *image;
+    struct FILE_ENTRY *files;
+    uint8_t *owner;                 // File index of each cluster, 0xFF if none
+    uint32_t clusters;
+};
+
+
+static int owners_load(struct OWNERS *owners, const struct IMAGE *image, uint32_t sectors) {
+    struct BPB bpb = image->bpb;
+
+    memset(owners, 0, sizeof(*owners));
+    owners->image = image;
+    owners->clusters = (sectors - bpb.data_start_sector) / bpb.sectors_per_cluster + 2;
+    owners->owner = (uint8_t *)malloc(owners->clusters);
+    owners->files = (struct FILE_ENTRY *)calloc(bpb.root_dir_entries + 1, sizeof(struct FILE_ENTRY));
+    if (owners->owner == NULL || owners->files == NULL) {
+        free(owners->owner);
+        free(owners->files);
+        return -1;
+    }
+    memset(owners->owner, 0xFF, owners->clusters);
+
+    // Every chain is walked, the FAT is decoded once for all of them
+    struct FAT12_FAT *fat = (struct FAT12_FAT *)malloc(sizeof(struct FAT12_FAT));
+    if (fat != NULL) {
+        fat12_decode_fat(fat, &bpb, image->head);
+        fat12_fat = fat;
+    }
+
+    uint8_t count = get_files(&bpb, image->head, owners->files);
+    for (uint8_t i = 0; i < count && i < 0xFF; i++) {
+        uint32_t cluster = owners->files[i].cluster;
+        for (uint32_t steps = 0; cluster >= 2 && cluster < 0xFF8 && cluster < owners->clusters &&
+             steps < owners->clusters; steps++) {
+            owners->owner[cluster] = i;
+            cluster = get_next_cluster(&bpb, (uint16_t)cluster, image->head);
+        }
+    }
+    fat12_fat = NULL;
+    free(fat);
+    return 0;
+}
+
+
+static void owners_free(struct OWNERS *owners) {
+    free(owners->owner);
+    free(owners->files);
+}
+
+
+static void print_range(uint32_t first, uint32_t count, void *arg) {
+    struct OWNERS *owners = (struct OWNERS *)arg;
+    const struct BPB *bpb = &owners->image->bpb;
+    int region = MERKLE_DATA;
+
+    if (first < bpb->reserved_sectors) region = MERKLE_BOOT;
+    else if (first < bpb->root_dir_sector) region = MERKLE_FAT;
+    else if (first < bpb->data_start_sector) region = MERKLE_ROOT_DIR;
+
+    printf("  sectors %5u-%-5u %-15s", first, first + count - 1, merkle_region_names[region]);
+
+    // The files of the clusters, each once
+    if (region == MERKLE_DATA && owners->owner != NULL) {
+        int last = -1;
+        for (uint32_t s = first; s < first + count; s++) {
+            uint32_t cluster = (s - bpb->data_start_sector) / bpb->sectors_per_cluster + 2;
+            int owner = (cluster < owners->clusters) ? owners->owner[cluster] : 0xFF;
+            if (owner == last) continue;
+            printf(" %s", (owner == 0xFF) ? "(free)" : owners->files[owner].name);
+            last = owner;
+        }
+    }
+    printf("\n");
+}
+
+
+// Changed sector ranges of b against a, the files are those of image
+static int64_t print_diff(const struct MERKLE_TREE *a, const struct MERKLE_TREE *b, const struct IMAGE *image) {
+    struct OWNERS owners;
+    uint32_t compared = 0;
+
+    if (owners_load(&owners, image, b->sectors) != 0) memset(&owners, 0, sizeof(owners));
+    owners.image = image;
+    int64_t sectors = merkle_diff(a, b, print_range, &owners, &compared);
+    owners_free(&owners);
+
+    if (sectors < 0) {
+        printf("The images do not have the same geometry\n");
+    } else {
+        printf("%lld of %u sectors differ, %u nodes compared\n", (long long)sectors, a->sectors, compared);
+    }
+    return sectors;
+}
+
+
+/************************************************************************************
+ * Commands
+ ************************************************************************************/
+
+static int cmd_build(struct IMAGE *image) {
+    struct MERKLE_TREE tree;
+
+    if (image_hash(image, &tree) != 0) return 1;
+    printf("%s: %u sectors of %u bytes\n", image->path, tree.sectors, tree.sector_size);
+    print_roots(&tree);
+    int result = merkle_save(&tree, image->tree_path, image->size, image->mtime);
+    merkle_free(&tree);
+    return result != 0;
+}
+
+
+// Only the listed sectors and their ancestors are hashed
+static int cmd_dirty(struct IMAGE *image, const char *list) {
+    struct MERKLE_TREE tree;
+    uint64_t size;
+    int64_t mtime;
+
+    if (merkle_load(&tree, image->tree_path, &size, &mtime) != 0 || size != image->size) {
+        fprintf(stderr, "%s: no saved tree of this image, run without --dirty first\n", image->path);
+        return 1;
+    }
+
+    uint8_t *sector = (uint8_t *)malloc(tree.sector_size);
+    uint32_t hashed = 0;
+    int result = (sector == NULL);
+    const char *p = list;
+    while (result == 0 && *p) {
+        char *end;
+        unsigned long first = strtoul(p, &end, 0), last = first;
+        if (*end == '-') last = strtoul(end + 1, &end, 0);
+        if (end == p || last < first || last >= tree.sectors || (*end != ',' && *end != 0)) {
+            fprintf(stderr, "Bad sector list: %s\n", list);
+            result = 1;
+            break;
+        }
+        for (unsigned long s = first; s <= last && result == 0; s++) {
+            if (image_read_sector(image, (uint32_t)s, sector) != 0) result = 1;
+            else merkle_set_sector(&tree, (uint32_t)s, sector);
+            hashed++;
+        }
+        p = (*end == ',') ? end + 1 : end;
+    }
+
+    if (result == 0) {
+        printf("%s: %u of %u sectors hashed\n", image->path, hashed, tree.sectors);
+        print_roots(&tree);
+        result = merkle_save(&tree, image->tree_path, image->size, image->mtime) != 0;
+    }
+    free(sector);
+    merkle_free(&tree);
+    return result;
+}
+
+
+static int cmd_verify(struct IMAGE *image) {
+    struct MERKLE_TREE saved, tree;
+    uint64_t size;
+    int64_t mtime;
+
+    if (merkle_load(&saved, image->tree_path, &size, &mtime) != 0) {
+        fprintf(stderr, "%s: no saved tree, run without --verify first\n", image->path);
+        return 1;
+    }
+    if (image_hash(image, &tree) != 0) {
+        merkle_free(&saved);
+        return 1;
+    }
+
+    int64_t sectors = print_diff(&saved, &tree, image);
+    if (sectors != 0) merkle_save(&tree, image->tree_path, image->size, image->mtime);
+    merkle_free(&saved);
+    merkle_free(&tree);
+    return sectors != 0;
+}
+
+
+static int cmd_diff(struct IMAGE *a, struct IMAGE *b) {
+    struct MERKLE_TREE tree_a, tree_b;
+    int saved_a, saved_b;
+
+    if (image_tree(a, &tree_a, &saved_a) != 0) return 1;
+    if (image_tree(b, &tree_b, &saved_b) != 0) {
+        merkle_free(&tree_a);
+        return 1;
+    }
+    printf("%s (%s) and %s (%s)\n", a->path, saved_a ? "saved tree" : "hashed",
+           b->path, saved_b ? "saved tree" : "hashed");
+
+    int64_t sectors = print_diff(&tree_a, &tree_b, b);
+    merkle_free(&tree_a);
+    merkle_free(&tree_b);
+    return sectors != 0;
+}
+
+
+int main(int argc, char *argv[]) {
+    struct IMAGE image, other;
+    int result;
+
+    fat12_trace = 0;
+
+    if (argc == 2 && argv[1][0] != '-') {
+        if (image_open(&image, argv[1]) != 0) return 1;
+        result = cmd_build(&image);
+    } else if (argc == 3 && strncmp(argv[1], "--dirty=", 8) == 0) {
+        if (image_open(&image, argv[2]) != 0) return 1;
+        result = cmd_dirty(&image, argv[1] + 8);
+    } else if (argc == 3 && strcmp(argv[1], "--verify") == 0) {
+        if (image_open(&image, argv[2]) != 0) return 1;
+        result = cmd_verify(&image);
+    } else if (argc == 4 && strcmp(argv[1], "--diff") == 0) {
+        if (image_open(&image, argv[2]) != 0) return 1;
+        if (image_open(&other, argv[3]) != 0) {
+            image_close(&image);
+            return 1;
+        }
+        result = cmd_diff(&image, &other);
+        image_close(&other);
+    } else {
+        fprintf(stderr, "Usage: %s " USAGE "\n", argv[0], argv[0], argv[0], argv[0]);
+        return 1;
+    }
+
+    image_close(&image);
+    return result;
+}
@@ -0,0 +1,292 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "CRC32.h"
+#include "FAT12.h"
+#include "MERKLE.h"
+
+#define MERKLE_HEADER 64
+
+const char *merkle_region_names[MERKLE_REGIONS] = { "boot", "FAT", "root directory", "data" };
+
+
+static void merkle_put32(uint8_t *p, uint32_t value) {
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+    p[2] = (uint8_t)(value >> 16);
+    p[3] = (uint8_t)(value >> 24);
+}
+
+
+static uint32_t merkle_get32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+
+// Parent of two nodes
+static uint32_t merkle_pair(uint32_t left, uint32_t right) {
+    uint8_t pair[8];
+
+    merkle_put32(pair, left);
+    merkle_put32(pair + 4, right);
+    return crc32_compute(pair, sizeof(pair));
+}
+
+
+static uint32_t merkle_top(const struct MERKLE_TREE *tree) {
+    uint8_t roots[4 * MERKLE_REGIONS];
+
+    for (int r = 0; r < MERKLE_REGIONS; r++) merkle_put32(roots + 4 * r, merkle_region_root(tree, r));
+    return crc32_compute(roots, sizeof(roots));
+}
+
+
+// Node index of level (above the leaves) from its children
+static void merkle_node(struct MERKLE_TREE *tree, int r, uint32_t level, uint32_t index) {
+    const uint32_t *child = tree->node + tree->level[r][level - 1];
+    uint32_t left = 2 * index;
+
+    tree->node[tree->level[r][level] + index] = (left + 1 < tree->width[r][level - 1])
+        ? merkle_pair(child[left], child[left + 1]) : child[left];
+}
+
+
+int merkle_init(struct MERKLE_TREE *tree, const struct BPB *bpb, uint64_t image_size) {
+    memset(tree, 0, sizeof(*tree));
+    tree->sector_size = bpb->bytes_per_sector;
+    if (tree->sector_size == 0 || image_size / tree->sector_size > UINT32_MAX) return -1;
+    tree->sectors = (uint32_t)(image_size / tree->sector_size);
+
+    // The regions end at the image, whatever the BPB says
+    uint32_t start[MERKLE_REGIONS] = { 0, bpb->reserved_sectors, bpb->root_dir_sector, bpb->data_start_sector };
+    for (int r = 0; r < MERKLE_REGIONS; r++) {
+        tree->region[r] = (start[r] < tree->sectors) ? start[r] : tree->sectors;
+        if (r > 0 && tree->region[r] < tree->region[r - 1]) tree->region[r] = tree->region[r - 1];
+    }
+    tree->region[MERKLE_REGIONS] = tree->sectors;
+
+    // Levels of every subtree, one after the other in node
+    uint64_t nodes = 0;
+    for (int r = 0; r < MERKLE_REGIONS; r++) {
+        uint32_t width = tree->region[r + 1] - tree->region[r];
+        while (width > 0) {
+            tree->level[r][tree->height[r]] = (uint32_t)nodes;
+            tree->width[r][tree->height[r]++] = width;
+            nodes += width;
+            if (width == 1) break;
+            width = (width + 1) / 2;
+        }
+    }
+
+    tree->node = (uint32_t *)calloc(nodes ? (size_t)nodes : 1, sizeof(uint32_t));
+    if (tree->node == NULL) return -1;
+    merkle_update(tree);
+    return 0;
+}
+
+
+void merkle_free(struct MERKLE_TREE *tree) {
+    free(tree->node);
+    tree->node = NULL;
+}
+
+
+static int merkle_region_of(const struct MERKLE_TREE *tree, uint32_t sector) {
+    int r = MERKLE_REGIONS - 1;
+    while (r > 0 && sector < tree->region[r]) r--;
+    return r;
+}
+
+
+void merkle_set_leaf(struct MERKLE_TREE *tree, uint32_t sector, const uint8_t *data) {
+    int r = merkle_region_of(tree, sector);
+    tree->node[tree->level[r][0] + sector - tree->region[r]] = crc32_compute(data, tree->sector_size);
+}
+
+
+void merkle_set_sector(struct MERKLE_TREE *tree, uint32_t sector, const uint8_t *data) {
+    int r = merkle_region_of(tree, sector);
+    uint32_t index = sector - tree->region[r];
+
+    merkle_set_leaf(tree, sector, data);
+    for (uint32_t level = 1; level < tree->height[r]; level++) {
+        index /= 2;
+        merkle_node(tree, r, level, index);
+    }
+    tree->root = merkle_top(tree);
+}
+
+
+void merkle_update(struct MERKLE_TREE *tree) {
+    for (int r = 0; r < MERKLE_REGIONS; r++) {
+        for (uint32_t level = 1; level < tree->height[r]; level++) {
+            for (uint32_t i = 0; i < tree->width[r][level]; i++) merkle_node(tree, r, level, i);
+        }
+    }
+    tree->root = merkle_top(tree);
+}
+
+
+uint32_t merkle_region_root(const struct MERKLE_TREE *tree, int region) {
+    if (tree->height[region] == 0) return 0;
+    return tree->node[tree->level[region][tree->height[region] - 1]];
+}
+
+
+/************************************************************************************
+ * Comparison of two trees
+ ************************************************************************************/
+
+struct MERKLE_DIFF {
+    const struct MERKLE_TREE *a, *b;
+    merkle_range_fn fn;
+    void *arg;
+    uint32_t first, count;          // Range being merged
+    int64_t sectors;
+    uint32_t compared;
+};
+
+
+static void merkle_report(struct MERKLE_DIFF *diff, uint32_t sector) {
+    diff->sectors++;
+    if (diff->count > 0 && diff->first + diff->count == sector) {
+        diff->count++;
+        return;
+    }
+    if (diff->count > 0) diff->fn(diff->first, diff->count, diff->arg);
+    diff->first = sector;
+    diff->count = 1;
+}
+
+
+static void merkle_descend(struct MERKLE_DIFF *diff, int r, uint32_t level, uint32_t index) {
+    const struct MERKLE_TREE *a = diff->a, *b = diff->b;
+
+    diff->compared++;
+    if (a->node[a->level[r][level] + index] == b->node[b->level[r][level] + index]) return;
+
+    if (level == 0) {
+        merkle_report(diff, a->region[r] + index);
+        return;
+    }
+    merkle_descend(diff, r, level - 1, 2 * index);
+    if (2 * index + 1 < a->width[r][level - 1]) merkle_descend(diff, r, level - 1, 2 * index + 1);
+}
+
+
+int64_t merkle_diff(const struct MERKLE_TREE *a, const struct MERKLE_TREE *b,
+                    merkle_range_fn fn, void *arg, uint32_t *compared) {
+    struct MERKLE_DIFF diff;
+
+    if (a->sector_size != b->sector_size || memcmp(a->region, b->region, sizeof(a->region)) != 0) return -1;
+
+    memset(&diff, 0, sizeof(diff));
+    diff.a = a;
+    diff.b = b;
+    diff.fn = fn;
+    diff.arg = arg;
+    diff.compared = 1;
+    if (a->root != b->root) {
+        for (int r = 0; r < MERKLE_REGIONS; r++) {
+            if (a->height[r] > 0) merkle_descend(&diff, r, a->height[r] - 1, 0);
+        }
+        if (diff.count > 0) fn(diff.first, diff.count, arg);
+    }
+    if (compared) *compared = diff.compared;
+    return diff.sectors;
+}
+
+
+/************************************************************************************
+ * Saved tree
+ ************************************************************************************/
+
+int merkle_save(const struct MERKLE_TREE *tree, const char *path, uint64_t size, int64_t mtime) {
+    size_t file_size = MERKLE_HEADER + (size_t)tree->sectors * 4 + 4;
+    uint8_t *data = (uint8_t *)calloc(1, file_size);
+    if (data == NULL) {
+        perror("Memory allocation for the saved tree failed");
+        return -1;
+    }
+
+    memcpy(data, MERKLE_MAGIC, 4);
+    merkle_put32(data + 4, tree->sector_size);
+    merkle_put32(data + 8, tree->sectors);
+    for (int r = 0; r < MERKLE_REGIONS; r++) merkle_put32(data + 12 + 4 * r, tree->region[r]);
+    merkle_put32(data + 28, (uint32_t)size);
+    merkle_put32(data + 32, (uint32_t)(size >> 32));
+    merkle_put32(data + 36, (uint32_t)mtime);
+    merkle_put32(data + 40, (uint32_t)((uint64_t)mtime >> 32));
+    merkle_put32(data + 44, tree->root);
+
+    // The leaves of the regions follow each other in sector order
+    uint8_t *p = data + MERKLE_HEADER;
+    for (int r = 0; r < MERKLE_REGIONS; r++) {
+        for (uint32_t i = 0; i < tree->region[r + 1] - tree->region[r]; i++, p += 4) {
+            merkle_put32(p, tree->node[tree->level[r][0] + i]);
+        }
+    }
+    crc32_model_store(&crc32_model_ieee, crc32_compute(data, file_size - 4), data + file_size - 4);
+
+    int result = 0;
+    FILE *file = fopen(path, "wb");
+    if (file == NULL || fwrite(data, 1, file_size, file) != file_size) {
+        perror(path);
+        result = -1;
+    }
+    if (file != NULL && fclose(file) != 0) {
+        perror(path);
+        result = -1;
+    }
+    free(data);
+    return result;
+}
+
+
+int merkle_load(struct MERKLE_TREE *tree, const char *path, uint64_t *size, int64_t *mtime) {
+    uint8_t header[MERKLE_HEADER];
+    struct BPB bpb;
+
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) return -1;
+    if (fread(header, 1, sizeof(header), file) != sizeof(header) || memcmp(header, MERKLE_MAGIC, 4) != 0) {
+        fclose(file);
+        return -1;
+    }
+
+    // Same geometry as when it was saved
+    memset(&bpb, 0, sizeof(bpb));
+    bpb.bytes_per_sector = (uint16_t)merkle_get32(header + 4);
+    bpb.reserved_sectors = (uint16_t)merkle_get32(header + 16);
+    bpb.root_dir_sector = merkle_get32(header + 20);
+    bpb.data_start_sector = merkle_get32(header + 24);
+    *size = merkle_get32(header + 28) | ((uint64_t)merkle_get32(header + 32) << 32);
+    *mtime = (int64_t)(merkle_get32(header + 36) | ((uint64_t)merkle_get32(header + 40) << 32));
+    if (merkle_init(tree, &bpb, (uint64_t)merkle_get32(header + 8) * bpb.bytes_per_sector) != 0) {
+        fclose(file);
+        return -1;
+    }
+
+    size_t leaves_size = (size_t)tree->sectors * 4 + 4;
+    uint8_t *leaves = (uint8_t *)malloc(leaves_size);
+    int result = -1;
+    if (leaves != NULL && fread(leaves, 1, leaves_size, file) == leaves_size) {
+        uint32_t crc = crc32_update(crc32_update(CRC32_INIT, header, sizeof(header)), leaves, leaves_size);
+        if (crc32_final(crc) == crc32_model_residue(&crc32_model_ieee)) {
+            const uint8_t *p = leaves;
+            for (int r = 0; r < MERKLE_REGIONS; r++) {
+                for (uint32_t i = 0; i < tree->region[r + 1] - tree->region[r]; i++, p += 4) {
+                    tree->node[tree->level[r][0] + i] = merkle_get32(p);
+                }
+            }
+            merkle_update(tree);
+            if (tree->root == merkle_get32(header + 44)) result = 0;
+        }
+    }
+    free(leaves);
+    fclose(file);
+    if (result != 0) merkle_free(tree);
+    return result;
+}
@@ -0,0 +1,67 @@
+#ifndef __MERKLE_H__
+#define __MERKLE_H__
+
+#include <stdint.h>
+
+#include "FAT12.h"
+
+// CRC-32 Merkle tree over the sectors of a FAT12 image. Each region of the
+// image (boot/reserved sectors, FATs, root directory, data) is a subtree:
+// the leaves are the CRC-32 of the sectors, a node is the CRC-32 of its two
+// children (little endian, left first), an odd node at the end of a level is
+// carried up as it is. The root is the CRC-32 of the 4 region roots.
+// A changed sector costs its leaf and its ancestors, two trees are compared
+// from the root down, only into the subtrees that differ.
+
+#define MERKLE_BOOT     0
+#define MERKLE_FAT      1
+#define MERKLE_ROOT_DIR 2
+#define MERKLE_DATA     3
+#define MERKLE_REGIONS  4
+
+#define MERKLE_LEVELS   33          // Up to 2^32 leaves per region
+
+#define MERKLE_MAGIC    "MRKL"
+#define MERKLE_SUFFIX   ".MRK"      // Saved tree, next to the image
+
+extern const char *merkle_region_names[MERKLE_REGIONS];
+
+struct MERKLE_TREE {
+    uint32_t sector_size;
+    uint32_t sectors;                               // Sectors of the image
+    uint32_t region[MERKLE_REGIONS + 1];            // First sector of each region, then sectors
+    uint32_t height[MERKLE_REGIONS];                // Levels of each subtree, 0 if it is empty
+    uint32_t level[MERKLE_REGIONS][MERKLE_LEVELS];  // Offset of each level in node, leaves first
+    uint32_t width[MERKLE_REGIONS][MERKLE_LEVELS];  // Nodes of each level
+    uint32_t *node;
+    uint32_t root;
+};
+
+// Regions from the BPB, sectors of sector_size up to image_size (the dump
+// can be bigger than total_sectors). All the nodes are 0. Return 0, or -1.
+int merkle_init(struct MERKLE_TREE *tree, const struct BPB *bpb, uint64_t image_size);
+void merkle_free(struct MERKLE_TREE *tree);
+
+// Leaf of a sector (sector_size bytes at data) and its ancestors up to the root
+void merkle_set_sector(struct MERKLE_TREE *tree, uint32_t sector, const uint8_t *data);
+
+// Leaf of a sector without its ancestors, then merkle_update() once for all
+void merkle_set_leaf(struct MERKLE_TREE *tree, uint32_t sector, const uint8_t *data);
+void merkle_update(struct MERKLE_TREE *tree);
+
+uint32_t merkle_region_root(const struct MERKLE_TREE *tree, int region);
+
+// Ranges of sectors that differ between two trees of the same geometry, in
+// order, given to fn. Return the number of sectors that differ, -1 if the
+// geometries are not the same. compared gets the number of nodes compared.
+typedef void (*merkle_range_fn)(uint32_t first, uint32_t count, void *arg);
+int64_t merkle_diff(const struct MERKLE_TREE *a, const struct MERKLE_TREE *b,
+                    merkle_range_fn fn, void *arg, uint32_t *compared);
+
+// Saved tree: header, the leaves and a binary CRC-32 trailer; the inner
+// nodes are rebuilt when it is loaded. size and mtime are those of the
+// image it was made from. Return 0, or -1.
+int merkle_save(const struct MERKLE_TREE *tree, const char *path, uint64_t size, int64_t mtime);
+int merkle_load(struct MERKLE_TREE *tree, const char *path, uint64_t *size, int64_t *mtime);
+
+#endif // MERKLE_H
@@ -1,12 +1,15 @@
 
 #include <stdint.h>
 #include "FAT12.h"
+#include "CRC32.h"
 
 
 extern uint8_t NO_OF_FILES;
 extern struct FILE_ENTRY FILES[20];  // Array to store up to 20 files
-extern uint16_t last_cluster;
-extern uint32_t bytes_read_so_far;
+
+uint8_t fat12_trace = 1;
+struct FAT12_FAT *fat12_fat = NULL;
+struct FAT12_INDEX *fat12_index = NULL;
     
 
 // Function to read 16-bit values (little endian)
@@ -21,7 +24,7 @@ uint16_t read16(const uint8_t *buf, uint16_t offset) {
 // Function to read 32-bit values (little endian)
 uint32_t read32(const uint8_t *buf, uint16_t offset) {
     uint32_t result = 0;
-    result |= (buf[offset + 3] << 24);
+    result |= ((uint32_t)buf[offset + 3] << 24);  // Not int: a byte >= 0x80 would overflow it
     result |= (buf[offset + 2] << 16);
     result |= (buf[offset + 1] << 8);
     result |=  buf[offset];
@@ -45,7 +48,10 @@ void load_bpb(struct BPB *bpb, const char *buffer) {
 
     // Calculate start of data region
     bpb->data_start_sector = bpb->root_dir_sector + bpb->root_dir_size;    
+    bpb->geometry = fat12_geometry(bpb);
     
+    if (!fat12_trace) return;
+
     printf("\n        FAT12 data\n");
     printf("=========================\n");
     printf("Bytes_per_sector: %d\n", bpb->bytes_per_sector);
@@ -58,16 +64,60 @@ void load_bpb(struct BPB *bpb, const char *buffer) {
     printf("Root_dir_sector: %d\n", bpb->root_dir_sector);
     printf("Root_dir_size: %d\n", bpb->root_dir_size);
     printf("Data_start_sector: %d\n", bpb->data_start_sector);
+    printf("Geometry: %s\n", bpb->geometry == FAT12_GEOMETRY_4096X1 ? "4096 x 1" :
+                             bpb->geometry == FAT12_GEOMETRY_512X8 ? "512 x 8" : "generic");
     printf("=========================\n");    
 }
 
 
+uint8_t fat12_geometry(const struct BPB *bpb) {
+    if (bpb->bytes_per_sector == 4096 && bpb->sectors_per_cluster == 1) return FAT12_GEOMETRY_4096X1;
+    if (bpb->bytes_per_sector == 512 && bpb->sectors_per_cluster == 8) return FAT12_GEOMETRY_512X8;
+    return FAT12_GEOMETRY_GENERIC;
+}
+
+
+// Offsets of a sector and of a cluster for one geometry. With constant sizes
+// the compiler makes the multiplies shifts, generic takes them from the BPB.
+// In FAT12, cluster numbering starts from 2 (clusters 0 and 1 are reserved)
+#define FAT12_ADDRESSING(geometry, SECTOR_SIZE, SECTORS_PER_CLUSTER)                        \
+static uint32_t fat12_sector_offset_##geometry(const struct BPB *bpb, uint32_t sector) {    \
+    (void)bpb;                                                                              \
+    return sector * (SECTOR_SIZE);                                                          \
+}                                                                                           \
+static uint32_t fat12_cluster_offset_##geometry(const struct BPB *bpb, uint16_t cluster) {  \
+    return (bpb->data_start_sector + (uint32_t)(cluster - 2) * (SECTORS_PER_CLUSTER)) * (SECTOR_SIZE); \
+}
+
+FAT12_ADDRESSING(4096x1, 4096, 1)
+FAT12_ADDRESSING(512x8, 512, 8)
+FAT12_ADDRESSING(generic, bpb->bytes_per_sector, bpb->sectors_per_cluster)
+
+// Only the geometry the build is for is specialized, if it is given
+#ifdef FAT12_GEOMETRY
+#define FAT12_GEOMETRY_OF(bpb) ((bpb)->geometry == FAT12_GEOMETRY ? FAT12_GEOMETRY : FAT12_GEOMETRY_GENERIC)
+#else
+#define FAT12_GEOMETRY_OF(bpb) ((bpb)->geometry)
+#endif
+
+
+uint32_t fat12_sector_offset(const struct BPB *bpb, uint32_t sector) {
+    switch (FAT12_GEOMETRY_OF(bpb)) {
+    case FAT12_GEOMETRY_4096X1: return fat12_sector_offset_4096x1(bpb, sector);
+    case FAT12_GEOMETRY_512X8:  return fat12_sector_offset_512x8(bpb, sector);
+    default:                    return fat12_sector_offset_generic(bpb, sector);
+    }
+}
+
+
 // Function to get file data location from starting cluster
 uint32_t get_file_location(const struct BPB *bpb, uint16_t starting_cluster) {
-    // In FAT12, cluster numbering starts from 2 (clusters 0 and 1 are reserved)
-    uint32_t first_data_sector = bpb->data_start_sector;
-    uint32_t sector = first_data_sector + (starting_cluster - 2); // * bpb->sectors_per_cluster; - only one sector per cluster
-    return sector * 4096; // bpb->bytes_per_sector;  // Return byte offset in the buffer
+    // Return byte offset in the buffer
+    switch (FAT12_GEOMETRY_OF(bpb)) {
+    case FAT12_GEOMETRY_4096X1: return fat12_cluster_offset_4096x1(bpb, starting_cluster);
+    case FAT12_GEOMETRY_512X8:  return fat12_cluster_offset_512x8(bpb, starting_cluster);
+    default:                    return fat12_cluster_offset_generic(bpb, starting_cluster);
+    }
 }
 
 
@@ -149,6 +199,11 @@ uint8_t get_files(struct BPB *bpb, const char *buffer, struct FILE_ENTRY *files)
 
         // Calculate the file's location in the buffer
         files[file_counter].location = get_file_location(bpb, starting_cluster);
+        files[file_counter].cluster = starting_cluster;
+        files[file_counter].dir_entry = i;
+
+        // Runs of its chain, for the reads
+        fat12_build_extents(bpb, buffer, &files[file_counter]);
 
         // Increment file counter
         file_counter++;
@@ -157,6 +212,81 @@ uint8_t get_files(struct BPB *bpb, const char *buffer, struct FILE_ENTRY *files)
 }
 
 
+// FNV-1a of the 11 byte name
+static uint32_t fat12_name_hash(const char *raw) {
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < FAT12_FILENAME_LENGTH; i++) {
+        hash = (hash ^ (uint8_t)raw[i]) * 16777619u;
+    }
+    return hash;
+}
+
+
+// get_files names a file without extension "NAME."
+int fat12_raw_name(const char *filename, char *raw) {
+    const char *dot = strrchr(filename, '.');
+    if (dot == NULL || dot == filename || dot - filename > 8 || strlen(dot + 1) > 3 ||
+        dot[-1] == ' ' || (dot[1] != '\0' && dot[strlen(dot) - 1] == ' ')) {
+        return -1;
+    }
+    memset(raw, ' ', FAT12_FILENAME_LENGTH);
+    memcpy(raw, filename, dot - filename);
+    memcpy(raw + 8, dot + 1, strlen(dot + 1));
+    return 0;
+}
+
+
+static const char *fat12_dir_entry(const struct BPB *bpb, const char *buffer, uint16_t dir_entry) {
+    return buffer + bpb->root_dir_sector * bpb->bytes_per_sector + dir_entry * FAT12_ENTRY_SIZE;
+}
+
+
+int fat12_index_build(struct FAT12_INDEX *index, const struct BPB *bpb, const char *buffer,
+                      const struct FILE_ENTRY *files, uint8_t count) {
+    memset(index, 0, sizeof(*index));
+    index->bpb = bpb;
+    index->buffer = buffer;
+    index->files = files;
+    index->count = count;
+    if (count > FAT12_INDEX_SLOTS / 2) return -1;
+
+    for (uint8_t i = 0; i < count; i++) {
+        uint32_t s = fat12_name_hash(fat12_dir_entry(bpb, buffer, files[i].dir_entry));
+        while (index->slot[s & (FAT12_INDEX_SLOTS - 1)] != 0) s++;
+        index->slot[s & (FAT12_INDEX_SLOTS - 1)] = i + 1;
+    }
+    index->valid = 1;
+    return 0;
+}
+
+
+void fat12_index_invalidate(struct FAT12_INDEX *index) {
+    index->valid = 0;
+}
+
+
+const struct FILE_ENTRY *fat12_find(struct FAT12_INDEX *index, const char *filename) {
+    char raw[FAT12_FILENAME_LENGTH];
+
+    if (!index->valid || fat12_raw_name(filename, raw) != 0) return NULL;
+
+    for (uint32_t s = fat12_name_hash(raw); index->slot[s & (FAT12_INDEX_SLOTS - 1)] != 0; s++) {
+        const struct FILE_ENTRY *file = &index->files[index->slot[s & (FAT12_INDEX_SLOTS - 1)] - 1];
+        const char *entry = fat12_dir_entry(index->bpb, index->buffer, file->dir_entry);
+        if (memcmp(entry, raw, FAT12_FILENAME_LENGTH) != 0) continue;
+
+        // Still the file that was indexed
+        if ((uint8_t)entry[0] == 0xE5 || (entry[11] & 0x08) ||
+            read16((const uint8_t *)entry, 26) != file->cluster || read32((const uint8_t *)entry, 28) != file->size) {
+            index->valid = 0;
+            return NULL;
+        }
+        return file;
+    }
+    return NULL;
+}
+
+
 /********************************************************************************************************************
 *********************************************************************************************************************
 *********************************************************************************************************************
@@ -193,8 +323,24 @@ uint32_t get_next_cluster(const struct BPB *bpb, uint16_t current_cluster, const
 
 
 
-// VARIANTA 2 --- GOOD
-uint32_t get_next_cluster(const struct BPB *bpb, uint16_t current_cluster, const char *buffer) {
+// Unpack the whole FAT, 3 bytes hold the entries of 2 clusters
+uint16_t fat12_decode_fat(struct FAT12_FAT *fat, const struct BPB *bpb, const char *buffer) {
+    const uint8_t *p = (const uint8_t *)buffer + fat12_sector_offset(bpb, bpb->reserved_sectors);
+    uint32_t entries = (uint32_t)bpb->sectors_per_fat * bpb->bytes_per_sector * 2 / 3;
+    if (entries > FAT12_MAX_CLUSTERS) entries = FAT12_MAX_CLUSTERS;
+
+    fat->buffer = buffer;
+    fat->clusters = (uint16_t)entries;
+    for (uint32_t i = 0; i < entries; i += 2, p += 3) {
+        fat->next[i] = p[0] | ((p[1] & 0x0F) << 8);
+        if (i + 1 < entries) fat->next[i + 1] = (p[1] >> 4) | (p[2] << 4);
+    }
+    return fat->clusters;
+}
+
+
+// Entry of a cluster read from the packed FAT
+static uint16_t fat12_read_entry(const struct BPB *bpb, const char *buffer, uint16_t current_cluster) {
 
     // For Cluster 0: fat_offset = (0 * 3) / 2 = 0 (The first cluster entry starts at byte 0)
     // For Cluster 1: fat_offset = (1 * 3) / 2 = 1 (The entry starts at byte 1)
@@ -204,7 +350,7 @@ uint32_t get_next_cluster(const struct BPB *bpb, uint16_t current_cluster, const
     uint32_t fat_offset = (current_cluster * 3) / 2;  // 12 bits per entry, so 3 bytes represent 2 clusters
 
     // FAT table starts after reserved sectors
-    const char *fat_start = buffer + 4096; // 4096 = (bpb->reserved_sectors * bpb->bytes_per_sector);
+    const char *fat_start = buffer + fat12_sector_offset(bpb, bpb->reserved_sectors);
     
     uint16_t next_cluster;
 
@@ -219,13 +365,79 @@ uint32_t get_next_cluster(const struct BPB *bpb, uint16_t current_cluster, const
         next_cluster = (entry_value >> 4) & 0x0FFF;  // Upper 12 bits     // Odd index: take the upper 4 bits of the second byte and the third byte
     }
 
-    printf("\n=======================================================================\n");
-    printf("Current cluster: %u, Next cluster: %u\n", current_cluster, next_cluster);
-    printf("=======================================================================\n");
+    return next_cluster;
+}
+
+
+// Next cluster without the trace
+static uint16_t fat12_next(const struct BPB *bpb, const char *buffer, uint16_t current_cluster) {
+
+    // Decoded at mount: one load
+    if (fat12_fat != NULL && fat12_fat->buffer == buffer && current_cluster < fat12_fat->clusters) {
+        return fat12_fat->next[current_cluster];
+    }
+    return fat12_read_entry(bpb, buffer, current_cluster);
+}
+
+
+// VARIANTA 2 --- GOOD
+uint32_t get_next_cluster(const struct BPB *bpb, uint16_t current_cluster, const char *buffer) {
+
+    uint16_t next_cluster = fat12_next(bpb, buffer, current_cluster);
+
+    if (fat12_trace) {
+        printf("\n=======================================================================\n");
+        printf("Current cluster: %u, Next cluster: %u\n", current_cluster, next_cluster);
+        printf("=======================================================================\n");
+    }
     
     return next_cluster;
 }
 
+
+uint8_t fat12_build_extents(const struct BPB *bpb, const char *buffer, struct FILE_ENTRY *file) {
+    uint32_t cluster_size = bpb->sectors_per_cluster * bpb->bytes_per_sector;
+    uint16_t cluster = file->cluster;
+    uint8_t count = 0;
+
+    file->extents = 0;
+    if (cluster_size == 0) return 0;
+
+    // Only the clusters the size needs, a loop in the chain cannot hold it
+    uint32_t clusters = (file->size + cluster_size - 1) / cluster_size;
+    for (uint32_t i = 0; i < clusters; i++) {
+        if (cluster < 2 || cluster >= 0xFF8) return 0;
+
+        if (count > 0 && file->extent[count - 1].cluster + file->extent[count - 1].count == cluster) {
+            file->extent[count - 1].count++;
+        } else {
+            if (count == FAT12_MAX_EXTENTS) return 0;
+            file->extent[count].cluster = cluster;
+            file->extent[count].count = 1;
+            count++;
+        }
+        if (i + 1 < clusters) cluster = fat12_next(bpb, buffer, cluster);
+    }
+
+    file->extents = count;
+    return count;
+}
+
+
+// Cluster of file cluster index from the runs, and the clusters that follow
+// it in its run (itself included). Return 0, -1 past the runs.
+static int fat12_extent_at(const struct FILE_ENTRY *file, uint32_t index, uint16_t *cluster, uint32_t *run) {
+    for (uint8_t e = 0; e < file->extents; e++) {
+        if (index < file->extent[e].count) {
+            *cluster = (uint16_t)(file->extent[e].cluster + index);
+            *run = file->extent[e].count - index;
+            return 0;
+        }
+        index -= file->extent[e].count;
+    }
+    return -1;
+}
+
 /********************************************************************************************************************
 *********************************************************************************************************************
 *********************************************************************************************************************
@@ -237,135 +449,70 @@ uint32_t get_next_cluster(const struct BPB *bpb, uint16_t current_cluster, const
 // Function to load a file into the buffer
 int load_file_to_buffer(struct BPB *bpb, const char *buffer, const char *filename_to_find, char *fileBuffer, uint32_t buffer_size) {
       
+    // Name index of the image: no scan of the root directory
+    if (fat12_index != NULL && fat12_index->buffer == buffer && fat12_index->valid) {
+        const struct FILE_ENTRY *file_entry = fat12_find(fat12_index, filename_to_find);
+        struct FAT12_FILE file;
+
+        if (file_entry != NULL) {
+            if (file_entry->size > buffer_size) {
+                printf("Error: Buffer too small for file %s (size: %u bytes)\n", filename_to_find, file_entry->size);
+                return -1;  // File size exceeds buffer
+            }
+            if (fat12_open(&file, bpb, buffer, file_entry, NULL) != 0) return -1;
+            return fat12_read(&file, fileBuffer, file_entry->size);
+        }
+        if (fat12_index->valid) {
+            printf("File %s not found\n", filename_to_find);
+            return -1;  // File not found
+        }
+    }
     
     uint32_t root_dir_offset = bpb->root_dir_sector * bpb->bytes_per_sector;
 
 
-    // Iterate through the root directory entries
-    for (uint16_t i = 0; i < bpb->root_dir_entries; i++) 
-    {
-                    
-            const char *entry = buffer + root_dir_offset + i * FAT12_ENTRY_SIZE;
-    
-    
-            // First byte 0x00 indicates no more entries
-            if (entry[0] == 0x00) break;
-    
-            // Check if it's a valid file (skip deleted/unused entries)
-            if ((uint8_t)entry[0] == 0xE5 || (entry[11] & 0x08)) continue;
-    
-    
-            // Extract filename (8 chars) and extension (3 chars)
-            char filename[9] = {0};
-            char ext[4] = {0};
-            strncpy(filename, entry, 8);
-            strncpy(ext, entry + 8, 3);
-    
-            // Remove trailing spaces from filename and extension
-            for (int j = 7; j >= 0 && filename[j] == ' '; j--) {
-                filename[j] = '\0';
-            }
-            for (int j = 2; j >= 0 && ext[j] == ' '; j--) {
-                ext[j] = '\0';
-            }
-            // Combine the filename and extension to compare with the target
-            char full_filename[FAT12_FILENAME_LENGTH + 2] = {0};  // 8.3 format + dot
-            snprintf(full_filename, sizeof(full_filename), "%.8s.%.3s", filename, ext);
-    
-    
-            // Compare with the target file name (case-sensitive)
-            if (strcmp(full_filename, filename_to_find) == 0) 
-            {
-            
-                    // Extract the file size (little endian, 4 bytes at offset 28)
-                    uint32_t file_size = read32((uint8_t*)entry, 28);
-                    
-                                 
-                    if (file_size > buffer_size) {
-                        printf("Error: Buffer too small for file %s (size: %u bytes)\n", filename_to_find, file_size);
-                        return -1;  // File size exceeds buffer
-                    }
-        
-        
-                    // Extract the starting cluster (little endian)
-                    uint16_t current_cluster = read16((uint8_t*)entry, 26);
-        
-         
-                    // Read the file data cluster by cluster
-                    uint32_t bytes_read = 0;
-                    
-                    
-                    while (bytes_read < file_size) 
-                    {
-                            // Get file cluster location
-                            // In FAT12, cluster numbering starts from 2 (clusters 0 and 1 are reserved)
-                            //uint32_t sector = bpb->data_start_sector + (current_cluster - 2); // * bpb->sectors_per_cluster; // only one sector per cluster
-                            //uint32_t cluster_location = sector * 4096; // bpb->bytes_per_sector;  // Return byte offset in the buffer   
-                            
-                            uint32_t cluster_location = get_file_location(bpb, current_cluster);
-                            
-                            
-                                    printf("bpb->data_start_sector = %X\n", bpb->data_start_sector); 
-                                                                       
-                                    printf("file_size = %u\n", file_size); 
+    // The name in the on-disk form (11 bytes, space padded), compared with
+    // each entry as it is instead of formatting every entry to "NAME.EXT"
+    char raw[FAT12_FILENAME_LENGTH];
+    int found = (fat12_raw_name(filename_to_find, raw) == 0)
+        ? fat12_scan_name(buffer + root_dir_offset, bpb->root_dir_entries, raw) : -1;
 
-                            
-                            uint32_t cluster_size = 4096; // 4096 = bpb->sectors_per_cluster * bpb->bytes_per_sector;
-                            
-                                    //printf("cluster_size = %u\n", cluster_size);
-                            
-                            uint32_t remaining_bytes = file_size - bytes_read;
-                                    
-                                    printf("bytes_read = %u\n", bytes_read);
-                            
-                            uint32_t bytes_to_copy = (remaining_bytes < cluster_size) ? remaining_bytes : cluster_size;
-                        
-                                    printf("bytes_to_copy = %u\n", bytes_to_copy);
-                        
-                            // Ensure buffer has enough space
-                            if (bytes_read + bytes_to_copy > FILEBUFFER_SIZE) {
-                                fprintf(stderr, "Error: Buffer overflow. fileBuffer size: %u, bytes to copy: %u\n", FILEBUFFER_SIZE, bytes_to_copy);
-                                //break;
-                            }
-                        
-                            // Copy data from the cluster to the file buffer
-                            //memcpy(fileBuffer + bytes_read, buffer + cluster_location, bytes_to_copy);
-                            
-                            // Easier to implement this in micro using SPI :)
-                            for (size_t i = 0; i < bytes_to_copy; i++) {
-                                fileBuffer[bytes_read + i] = buffer[cluster_location + i];
-                            }
-                           
-                            // Update byte to copy counter
-                            bytes_read += bytes_to_copy;
-                        
-                            // Get the next cluster from the FAT
-                            current_cluster = get_next_cluster(bpb, current_cluster, buffer);
-                        
-                        
-                            // If we've read all the bytes needed, we are done
-                            if (bytes_read >= file_size) { 
-                                printf("\n================== All bytes were copied...\n\n");
-                                break;
-                            }            
-                        
-                            if (current_cluster >= 0xFF8){
-                                printf("\n================== Current cluster is the end of file...\n\n");
-                                break;
-                            }  
-                        
-                    }
-        
-                    //printf("==== File %s loaded into buffer (size: %u bytes)\n", filename_to_find, bytes_read);
-                    return bytes_read;  // Return the actual number of bytes read
-                                        
-            }
-                    
+    if (found < 0) {
+        printf("File %s not found\n", filename_to_find);
+        return -1;  // File not found
     }
 
-    printf("File %s not found\n", filename_to_find);
-    return -1;  // File not found
-                
+    const char *entry = buffer + root_dir_offset + found * FAT12_ENTRY_SIZE;
+    uint32_t file_size = read32((const uint8_t *)entry, 28);
+    uint16_t cluster = read16((const uint8_t *)entry, 26);
+
+    if (file_size > buffer_size) {
+        printf("Error: Buffer too small for file %s (size: %u bytes)\n", filename_to_find, file_size);
+        return -1;  // File size exceeds buffer
+    }
+
+    // The entry get_files made for it, with its runs, if it is still the same;
+    // otherwise the file is read from its chain
+    const struct FILE_ENTRY *file_entry = NULL;
+    struct FILE_ENTRY scanned;
+    if (fat12_index != NULL && fat12_index->buffer == buffer) {
+        for (uint8_t i = 0; i < fat12_index->count && file_entry == NULL; i++) {
+            const struct FILE_ENTRY *known = &fat12_index->files[i];
+            if (known->dir_entry == found && known->cluster == cluster && known->size == file_size) file_entry = known;
+        }
+    }
+    if (file_entry == NULL) {
+        memset(&scanned, 0, sizeof(scanned));
+        snprintf(scanned.name, sizeof(scanned.name), "%s", filename_to_find);
+        scanned.size = file_size;
+        scanned.cluster = cluster;
+        scanned.dir_entry = (uint16_t)found;
+        file_entry = &scanned;
+    }
+
+    struct FAT12_FILE file;
+    if (fat12_open(&file, bpb, buffer, file_entry, NULL) != 0) return -1;
+    return fat12_read(&file, fileBuffer, file_size);
 }
 
 /*
@@ -643,110 +790,331 @@ int load_file_to_buffer(struct BPB *bpb, const char *buffer, const char *filenam
 *********************************************************************************************************************/
 
 
-int load_file_chunk(struct BPB *bpb, const char *buffer, const struct FILE_ENTRY *file_entry,
-                    char *fileBuffer, uint32_t buffer_size, 
-                    uint32_t offset, uint32_t chunk_size, uint16_t *last_cluster, uint32_t *bytes_read_so_far) {
+// Per cluster CRC manifest, see FAT12.h
 
-    // Check if the file entry is valid
-    if (!file_entry) {
-        printf("Error: Invalid file entry\n");
+static void fat12_check_reset(struct FAT12_CHECK *check) {
+    check->span = 0;
+    check->checked = 0;
+    check->running = CRC32_INIT;
+}
+
+
+int fat12_manifest_load(struct FAT12_MANIFEST *manifest, const char *data, uint32_t size) {
+    const uint8_t *p = (const uint8_t *)data;
+
+    if (size < FAT12_MANIFEST_HEADER + 4 || memcmp(p, FAT12_MANIFEST_MAGIC, 4) != 0) {
+        printf("Error: Not a CRC manifest\n");
         return -1;
     }
 
-    // Extract file size and starting cluster from file_entry
-    uint32_t file_size = file_entry->size;
-    uint16_t starting_cluster = file_entry->location;
-        
-    uint16_t current_cluster;
-    if (last_cluster != NULL && *last_cluster != 0) {
-        current_cluster = *last_cluster;
-    } else {
-        current_cluster = starting_cluster;
-    }    
+    // Binary trailer: the CRC of the whole manifest is the CRC-32 residue
+    if (crc32_final(FAT12_CRC32_UPDATE(CRC32_INIT, p, size)) != FAT12_CRC32_RESIDUE) {
+        printf("Error: The CRC manifest is corrupt\n");
+        return -1;
+    }
 
-    printf("\n");
-    printf("File name: %s\n", file_entry->name);
-    printf("Starting cluster: 0x%X\n", starting_cluster);
-    printf("File size: %d\n", file_size);
-    
-    // If the offset exceeds the file size, return 0 (nothing more to read)
-    if (offset >= file_size) {
-        printf("Nothing more to read\n");
-        return 0;
+    manifest->cluster_size = read32(p, 4);
+    manifest->file_size = read32(p, 8);
+    manifest->count = read32(p, 12);
+    manifest->name = data + 16;
+    manifest->crc = p + FAT12_MANIFEST_HEADER;
+    fat12_check_reset(&manifest->stream);
+
+    if (manifest->cluster_size == 0 || size != FAT12_MANIFEST_HEADER + manifest->count * 4 + 4 ||
+        manifest->count != (manifest->file_size + manifest->cluster_size - 1) / manifest->cluster_size) {
+        printf("Error: The CRC manifest is corrupt\n");
+        return -1;
     }
+    return 0;
+}
 
-    // Calculate starting position (skip clusters if offset is beyond the first cluster)
-    uint32_t bytes_read = (bytes_read_so_far) ? *bytes_read_so_far : 0;
-    uint32_t cluster_size = bpb->sectors_per_cluster * bpb->bytes_per_sector;
-    uint32_t chunk_read = 0;
 
-    // Print the calculated values in hexadecimal
-    printf("Bytes read so far: %d\n", bytes_read);
-    printf("Cluster size: 0x%X\n", cluster_size);
-    
-    // Skip clusters to reach the starting offset
-    while (bytes_read < offset) {
-        current_cluster = get_next_cluster(bpb, current_cluster, buffer);
-        if (current_cluster >= 0xFF8 || current_cluster == 0xFFFF) {
-            printf("Error: Reached end of file before reaching offset\n");
+int fat12_check_cluster(const struct FAT12_MANIFEST *manifest, uint32_t index, const char *data, uint32_t len) {
+    if (index >= manifest->count) return -1;
+    uint32_t crc = crc32_final(FAT12_CRC32_UPDATE(CRC32_INIT, data, len));
+    return (crc == read32(manifest->crc + index * 4, 0)) ? 0 : -1;
+}
+
+
+// The bytes pos to pos + len of the file, all in the cluster at cluster_data.
+// Sequential reads are CRCed as they go and the cluster is compared when its
+// last byte is read. A read that starts past the checked bytes (a seek) checks
+// its whole cluster at once, so random chunks are checked on their own.
+// A cluster that does not match is not kept as checked, it fails again.
+static int fat12_manifest_feed(const struct FAT12_MANIFEST *manifest, struct FAT12_CHECK *check,
+                               const char *cluster_data, uint32_t pos, uint32_t len) {
+    uint32_t cluster_size = manifest->cluster_size;
+    uint32_t index = pos / cluster_size;
+    uint32_t start = index * cluster_size;
+    uint32_t cluster_len = manifest->file_size - start;
+    if (cluster_len > cluster_size) cluster_len = cluster_size;
+
+    // Already checked: whole clusters of the span
+    uint32_t checked_end = check->checked;
+    if (checked_end % cluster_size != 0 && checked_end != manifest->file_size) {
+        checked_end -= checked_end % cluster_size;
+    }
+    if (pos >= check->span && pos + len <= checked_end) return 0;
+
+    // Not the continuation of the span: the whole cluster, a new span
+    if (pos < check->span || pos > check->checked || pos + len <= check->checked) {
+        if (fat12_check_cluster(manifest, index, cluster_data, cluster_len) != 0) {
+            fat12_check_reset(check);
             return -1;
         }
-        bytes_read += cluster_size;
+        check->span = start;
+        check->checked = start + cluster_len;
+        check->running = CRC32_INIT;
+        return 0;
     }
 
-    printf("Bytes read so far: %d\n", bytes_read);
-    printf(" ===\n");
+    uint32_t from = check->checked - start;
+    uint32_t running = FAT12_CRC32_UPDATE(check->running, cluster_data + from, pos + len - check->checked);
+    if (pos + len < start + cluster_len) {
+        check->running = running;
+        check->checked = pos + len;
+        return 0;
+    }
 
-    // Now start reading chunks from the offset
-    while (chunk_read < chunk_size && bytes_read < file_size) {
-        
-        uint32_t cluster_location = get_file_location(bpb, current_cluster);
-        if (cluster_location == UINT32_MAX) { // Error retrieving location
-            printf("Error: Could not retrieve cluster location\n");
-            return -1;
-        }
+    if (index >= manifest->count || crc32_final(running) != read32(manifest->crc + index * 4, 0)) {
+        fat12_check_reset(check);
+        return -1;
+    }
+    check->running = CRC32_INIT;
+    check->checked = pos + len;
+    return 0;
+}
 
-        uint32_t remaining_bytes = file_size - bytes_read;
-        uint32_t bytes_to_copy = (remaining_bytes < cluster_size) ? remaining_bytes : cluster_size;
 
-        // Adjust bytes_to_copy if it exceeds the chunk size
-        if (bytes_to_copy > chunk_size - chunk_read) {
-            bytes_to_copy = chunk_size - chunk_read;
-        }
+/************************************************************************************
+ * Open file
+ ************************************************************************************/
+
+// Make the cluster of file cluster index the current one. Inside the run of
+// the current cluster it is an addition, otherwise the runs are searched or,
+// without runs, the chain is walked from the nearest known cluster before it.
+static int fat12_locate(struct FAT12_FILE *file, uint32_t index) {
+    const struct FILE_ENTRY *entry = file->entry;
+
+    if (index >= file->index && index - file->index < file->run) {
+        file->cluster = (uint16_t)(file->cluster + (index - file->index));
+        file->run -= index - file->index;
+        file->index = index;
+        return 0;
+    }
+
+    if (entry->extents > 0) {
+        if (fat12_extent_at(entry, index, &file->cluster, &file->run) != 0) return -1;
+        file->index = index;
+        return 0;
+    }
+
+    // Nearest skip entry, unless the current cluster is nearer
+    uint32_t k = index / file->skip_stride;
+    if (k >= file->skip_known) k = file->skip_known - 1;
+    if (index < file->index || k * file->skip_stride > file->index) {
+        file->index = k * file->skip_stride;
+        file->cluster = file->skip[k];
+    }
 
-        // Ensure buffer has enough space
-        if (chunk_read + bytes_to_copy > buffer_size) {
-            printf("Error: Buffer overflow. fileBuffer size: %u, bytes to copy: %u\n", buffer_size, bytes_to_copy);
+    while (file->index < index) {
+        file->cluster = (uint16_t)get_next_cluster(file->bpb, file->cluster, file->buffer);
+        if (file->cluster < 2 || file->cluster >= 0xFF8) {
+            // Back to a known cluster, the chain is shorter than the file
+            file->index = 0;
+            file->cluster = file->skip[0];
             return -1;
         }
+        file->index++;
+        if (file->index % file->skip_stride == 0 && file->index / file->skip_stride == file->skip_known &&
+            file->skip_known < FAT12_SKIP_ENTRIES) {
+            file->skip[file->skip_known++] = file->cluster;
+        }
+    }
+    file->run = 1;
+    return 0;
+}
 
-        // Copy the data from the cluster to the fileBuffer
-        memcpy(fileBuffer + chunk_read, buffer + cluster_location, bytes_to_copy);
-        chunk_read += bytes_to_copy;
-        bytes_read += bytes_to_copy;
 
-        // If we have read enough for this chunk, return
-        if (chunk_read >= chunk_size || bytes_read >= file_size) {
-            break;
-        }
+int fat12_open(struct FAT12_FILE *file, const struct BPB *bpb, const char *buffer,
+               const struct FILE_ENTRY *entry, struct FAT12_MANIFEST *manifest) {
+    memset(file, 0, sizeof(*file));
+    file->bpb = bpb;
+    file->buffer = buffer;
+    file->entry = entry;
+    file->manifest = manifest;
+    fat12_check_reset(&file->check);
+    file->cluster_size = bpb->sectors_per_cluster * bpb->bytes_per_sector;
+
+    if (file->cluster_size == 0) return -1;
+    if (manifest && manifest->cluster_size != file->cluster_size) {
+        printf("Error: The manifest of %s is for %u byte clusters, the image has %u (CRC32ToFile --cluster=%u)\n",
+               entry->name, manifest->cluster_size, file->cluster_size, file->cluster_size);
+        return -1;
+    }
+    char raw[FAT12_FILENAME_LENGTH];
+    if (manifest && (fat12_raw_name(entry->name, raw) != 0 ||
+                     memcmp(raw, manifest->name, FAT12_FILENAME_LENGTH) != 0)) {
+        printf("Error: The manifest is not the one of %s (it is for \"%.11s\")\n", entry->name, manifest->name);
+        return -1;
+    }
+    if (manifest && manifest->file_size != entry->size) {
+        printf("Error: The manifest is not the one of %s (file size %u, manifest %u)\n",
+               entry->name, entry->size, manifest->file_size);
+        return -1;
+    }
 
-        // Move to the next cluster
-        current_cluster = get_next_cluster(bpb, current_cluster, buffer);
+    // The skip entries spread over the whole chain
+    uint32_t clusters = (entry->size + file->cluster_size - 1) / file->cluster_size;
+    file->skip_stride = (clusters + FAT12_SKIP_ENTRIES - 1) / FAT12_SKIP_ENTRIES;
+    if (file->skip_stride == 0) file->skip_stride = 1;
+    file->skip[0] = entry->cluster;
+    file->skip_known = 1;
 
-        // Check if we have reached the end of the file
-        if (current_cluster >= 0xFF8) {
-            break;
-        }
+    file->cluster = entry->cluster;
+    file->run = 1;
+    if (entry->extents > 0) file->run = entry->extent[0].count;
+    return 0;
+}
+
+
+int fat12_seek(struct FAT12_FILE *file, uint32_t offset) {
+    if (offset > file->entry->size) return -1;
+    if (offset < file->entry->size && fat12_locate(file, offset / file->cluster_size) != 0) return -1;
+    file->position = offset;
+    return 0;
+}
+
+
+// Bytes of the file from the position up to len, the end of the file or the
+// end of the run (of the cluster with a manifest, it is checked cluster by
+// cluster), where they are in the image, and the position moved past them.
+// Return their count, 0 at the end of the file, -1 or FAT12_CRC_ERROR.
+static int fat12_next_span(struct FAT12_FILE *file, uint32_t len, struct FAT12_SPAN *span) {
+    uint32_t file_size = file->entry->size;
+    uint32_t cluster_size = file->cluster_size;
+
+    if (len == 0 || file->position >= file_size) return 0;
+
+    uint32_t location = get_file_location(file->bpb, file->cluster);
+    uint32_t in_cluster = file->position - file->index * cluster_size;
+    uint32_t contiguous = (file->manifest ? 1 : file->run) * cluster_size - in_cluster;
+    uint32_t length = file_size - file->position;
+    if (length > contiguous) length = contiguous;
+    if (length > len) length = len;
+
+    // Manifest check: a cluster is compared when its last byte is read,
+    // or at once when the read starts past the checked bytes
+    if (file->manifest &&
+        fat12_manifest_feed(file->manifest, &file->check, file->buffer + location, file->position, length) != 0) {
+        printf("Error: CRC mismatch in cluster %u of %s (file offset %u)\n",
+               file->index, file->entry->name, file->index * cluster_size);
+        return FAT12_CRC_ERROR;
     }
 
-    // Save the current cluster and bytes_read position for subsequent calls
-    if (last_cluster) {
-        *last_cluster = current_cluster;
+    span->data = file->buffer + location + in_cluster;
+    span->length = length;
+    file->position += length;
+
+    // On to the cluster that holds the position
+    if (file->position < file_size && fat12_locate(file, file->position / cluster_size) != 0) {
+        printf("Error: The chain of %s ends before the file\n", file->entry->name);
+        return -1;
+    }
+    return (int)length;
+}
+
+
+int fat12_read(struct FAT12_FILE *file, char *data, uint32_t len) {
+    struct FAT12_SPAN span;
+    uint32_t done = 0;
+
+    while (done < len) {
+        int bytes = fat12_next_span(file, len - done, &span);
+        if (bytes < 0) return bytes;
+        if (bytes == 0) break;
+
+        memcpy(data + done, span.data, span.length);
+        done += span.length;
     }
-    if (bytes_read_so_far) {
-        *bytes_read_so_far = bytes_read;
+    return done;
+}
+
+
+int fat12_spans(struct FAT12_FILE *file, uint32_t len, struct FAT12_SPAN *spans, int max_spans, uint32_t *bytes) {
+    uint32_t done = 0;
+    int count = 0;
+
+    while (count < max_spans && done < len) {
+        int result = fat12_next_span(file, len - done, &spans[count]);
+        if (result < 0) return result;
+        if (result == 0) break;
+
+        done += spans[count++].length;
     }
+    if (bytes) *bytes = done;
+    return count;
+}
+
+
+// Kept for the callers of the first version, a FAT12_FILE does the work.
+// last_cluster/bytes_read_so_far only save the walk from the first cluster.
+int load_file_chunk(struct BPB *bpb, const char *buffer, const struct FILE_ENTRY *file_entry,
+                    char *fileBuffer, uint32_t buffer_size, 
+                    uint32_t offset, uint32_t chunk_size, uint16_t *last_cluster, uint32_t *bytes_read_so_far,
+                    struct FAT12_MANIFEST *manifest) {
+    struct FAT12_FILE file;
+
+    // Check if the file entry is valid
+    if (!file_entry) {
+        printf("Error: Invalid file entry\n");
+        return -1;
+    }
+
+    printf("\n");
+    printf("File name: %s\n", file_entry->name);
+    printf("Starting cluster: 0x%X\n", file_entry->cluster);
+    printf("File size: %d\n", file_entry->size);
 
+    // If the offset exceeds the file size, return 0 (nothing more to read)
+    if (offset >= file_entry->size) {
+        printf("Nothing more to read\n");
+        return 0;
+    }
+
+    if (fat12_open(&file, bpb, buffer, file_entry, manifest) != 0) return -1;
+
+    // What the last calls checked, the FAT12_FILE lives for this call only
+    if (manifest) file.check = manifest->stream;
+
+    // Go on from the cluster of the last call, it holds byte bytes_read_so_far
+    if (last_cluster && *last_cluster != 0 && bytes_read_so_far && *bytes_read_so_far <= offset &&
+        *bytes_read_so_far < file_entry->size && file_entry->extents == 0) {
+        file.index = *bytes_read_so_far / file.cluster_size;
+        file.cluster = *last_cluster;
+    }
+
+    if (fat12_seek(&file, offset) != 0) {
+        printf("Error: Reached end of file before reaching offset\n");
+        return -1;
+    }
+
+    // Ensure buffer has enough space
+    uint32_t bytes_to_copy = file_entry->size - offset;
+    if (bytes_to_copy > chunk_size) bytes_to_copy = chunk_size;
+    if (bytes_to_copy > buffer_size) {
+        printf("Error: Buffer overflow. fileBuffer size: %u, bytes to copy: %u\n", buffer_size, bytes_to_copy);
+        return -1;
+    }
+
+    int chunk_read = fat12_read(&file, fileBuffer, chunk_size);
+    if (manifest) manifest->stream = file.check;
+
+    // Save the current cluster and bytes_read position for subsequent calls
+    if (chunk_read >= 0) {
+        if (last_cluster) *last_cluster = file.cluster;
+        if (bytes_read_so_far) *bytes_read_so_far = file.position;
+    }
     return chunk_read;  // Return the number of bytes read in this chunk
 }
 
@@ -28,22 +28,181 @@ struct BPB {
     uint32_t root_dir_sector;
     uint32_t root_dir_size;
     uint32_t data_start_sector; // New field to store the start of data region
+    uint8_t geometry;           // FAT12_GEOMETRY_* of the sector and cluster sizes
 };
 
+// Sector and cluster sizes. The 25Q32 flash (4096 byte sectors, one per
+// cluster) and SD cards (512 byte sectors, 8 per cluster) are addressed with
+// the sizes as constants, the multiplies are shifts; any other geometry with
+// the sizes of the BPB. Built with -DFAT12_GEOMETRY=FAT12_GEOMETRY_4096X1
+// (or 512X8) only that one is specialized, the others take the generic path.
+#define FAT12_GEOMETRY_GENERIC 0
+#define FAT12_GEOMETRY_4096X1  1
+#define FAT12_GEOMETRY_512X8   2
+
+// Geometry of the sizes in the BPB (load_bpb sets it)
+uint8_t fat12_geometry(const struct BPB *bpb);
+
+// Byte offset of a sector in the image
+uint32_t fat12_sector_offset(const struct BPB *bpb, uint32_t sector);
+
+// Run of clusters that follow each other on the flash
+struct FAT12_EXTENT {
+    uint16_t cluster;       // First cluster
+    uint16_t count;         // Clusters in the run
+};
+
+// Runs kept per file. A freshly formatted flash has files in one run; a file
+// in more runs than this is read by walking the FAT as before.
+#ifndef FAT12_MAX_EXTENTS
+#define FAT12_MAX_EXTENTS 8
+#endif
+
 // Structure to store file information
 struct FILE_ENTRY {
     uint8_t index;          // File index
     char name[13];          // Filename in 8.3 format (8 chars + dot + 3 chars + null terminator)
     uint32_t size;          // File size
     uint32_t location;      // File location (starting cluster/sector)
+    uint16_t cluster;       // Starting cluster
+    uint16_t dir_entry;     // Its entry in the root directory
+    uint8_t extents;        // Runs in extent, 0 if the chain was not mapped
+    struct FAT12_EXTENT extent[FAT12_MAX_EXTENTS];
+};
+
+
+// Per cluster CRC manifest (<name>.CRM, made by CRC32ToFile --manifest and
+// copied in the image next to the file). All the fields are little endian:
+//   "CRCM", cluster size, file size, cluster count, the 11 byte name of the
+//   file as in its directory entry and a 0, one CRC-32 per cluster, and the
+//   binary CRC-32 trailer of the manifest itself.
+// A.HTM and A.TXT share A.CRM, fat12_open checks the name as well as the size.
+// With it load_file_chunk checks each cluster as it is streamed, a corrupt
+// cluster is caught at most one cluster after its first byte was sent.
+#define FAT12_MANIFEST_MAGIC  "CRCM"
+#define FAT12_MANIFEST_HEADER 28
+
+#define FAT12_CRC_ERROR -2      // load_file_chunk: a cluster does not match the manifest
+
+// CRC-32 engine of the checks (crc32_update on the PC, crc32_tier_update of
+// CRC32_TIERS.c on the microcontroller) and the CRC of data + binary trailer
+#ifndef FAT12_CRC32_UPDATE
+#define FAT12_CRC32_UPDATE crc32_update
+#endif
+#define FAT12_CRC32_RESIDUE 0x2144DF1C
+
+// What a reader has checked against the manifest. Only clusters that matched
+// count, a mismatch empties it.
+struct FAT12_CHECK {
+    uint32_t span;          // File bytes from span to checked are checked,
+    uint32_t checked;       // but those of a cluster still in running
+    uint32_t running;       // CRC register of the current cluster up to checked
+};
+
+struct FAT12_MANIFEST {
+    const uint8_t *crc;     // count CRCs, little endian, inside the manifest data
+    const char *name;       // FAT12_FILENAME_LENGTH bytes, inside the manifest data
+    uint32_t count;
+    uint32_t cluster_size;
+    uint32_t file_size;
+
+    // State of load_file_chunk from one call to the next, emptied by
+    // fat12_manifest_load. Each FAT12_FILE has its own.
+    struct FAT12_CHECK stream;
 };
 
+// Parse and check (its own trailer) a manifest loaded from the image.
+// Return 0, or -1 if it is not a manifest or it is corrupt.
+int fat12_manifest_load(struct FAT12_MANIFEST *manifest, const char *data, uint32_t size);
+
+// Check cluster index of the file, len bytes at data (shorter for the last one).
+// Return 0 if its CRC matches.
+int fat12_check_cluster(const struct FAT12_MANIFEST *manifest, uint32_t index, const char *data, uint32_t len);
+
+
+// Decoded FAT: the 12-bit entries of the first FAT unpacked once when the
+// image is mounted, so get_next_cluster is one indexed load instead of an
+// unaligned read, a shift and an even/odd branch for every cluster.
+// 2 bytes per cluster, 8 KB for the 4084 clusters FAT12 can have.
+#define FAT12_MAX_CLUSTERS 4096
+
+struct FAT12_FAT {
+    const char *buffer;                 // Image it was decoded from
+    uint16_t clusters;                  // Entries in next
+    uint16_t next[FAT12_MAX_CLUSTERS];  // Next cluster of each cluster, as in the FAT
+};
+
+// FAT used by get_next_cluster for its image, NULL (the default) to decode
+// the packed entries on every call as before
+extern struct FAT12_FAT *fat12_fat;
+
+// Unpack the FAT of the image at buffer. Return the number of entries.
+uint16_t fat12_decode_fat(struct FAT12_FAT *fat, const struct BPB *bpb, const char *buffer);
+
+
+// 0 turns off the BPB print of load_bpb and the cluster by cluster trace of
+// get_next_cluster, for the tools that walk every chain (readFAT12 keeps them)
+extern uint8_t fat12_trace;
 
 void load_bpb(struct BPB *bpb, const char *buffer);
 uint32_t get_file_location(const struct BPB *bpb, uint16_t starting_cluster);
 //uint32_t get_file_location_in_sectors(const struct BPB *bpb, uint16_t starting_cluster);
 
 uint8_t get_files(struct BPB *bpb, const char *buffer, struct FILE_ENTRY *files); // Return how many files
+
+// Map the chain of file (cluster and size set) to its runs, done by get_files.
+// Return the number of runs, 0 if the chain is shorter than the file or it
+// needs more than FAT12_MAX_EXTENTS runs.
+uint8_t fat12_build_extents(const struct BPB *bpb, const char *buffer, struct FILE_ENTRY *file);
+
+
+// "NAME.EXT" as the 11 bytes of its directory entry (raw). Return 0, -1 if
+// no entry can have it.
+int fat12_raw_name(const char *filename, char *raw);
+
+// Index of the root directory entry of the file named raw, -1 if there is
+// none before the end of the directory (FAT12_SCAN.c). fat12_scan_name uses
+// the scalar kernel; built with -DFAT12_SCAN_SIMD, the SSE2 (x86, after
+// CPUID) or NEON (AArch64) one.
+int fat12_scan_name(const char *dir, uint16_t entries, const char *raw);
+int fat12_scan_name_scalar(const char *dir, uint16_t entries, const char *raw);
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+int fat12_scan_name_sse2(const char *dir, uint16_t entries, const char *raw);
+#endif
+
+
+// Name index of the files of get_files, built once at mount: open addressing
+// on the 11 byte name as it is in the directory entry, so a name is found
+// without formatting and comparing every entry. A found file is checked
+// against its directory entry (name, cluster, size): a file deleted or
+// rewritten since the index was built makes it invalid, and the lookups fall
+// back to the directory scan. Code that adds or renames files must call
+// fat12_index_invalidate, or build the index again.
+#ifndef FAT12_INDEX_SLOTS
+#define FAT12_INDEX_SLOTS 64    // Power of 2, at least twice the files
+#endif
+
+struct FAT12_INDEX {
+    const struct BPB *bpb;
+    const char *buffer;                 // Image it was built from
+    const struct FILE_ENTRY *files;
+    uint8_t count;
+    uint8_t valid;
+    uint8_t slot[FAT12_INDEX_SLOTS];    // File index + 1, 0 if the slot is empty
+};
+
+// Index used by load_file_to_buffer for its image, NULL (the default) to scan
+// the root directory on every call as before
+extern struct FAT12_INDEX *fat12_index;
+
+// Index count files (from get_files). Return 0, -1 if there are too many.
+int fat12_index_build(struct FAT12_INDEX *index, const struct BPB *bpb, const char *buffer,
+                      const struct FILE_ENTRY *files, uint8_t count);
+void fat12_index_invalidate(struct FAT12_INDEX *index);
+
+// File "NAME.EXT" (case sensitive, as load_file_to_buffer), NULL if it is not
+// there or the index is not valid any more.
+const struct FILE_ENTRY *fat12_find(struct FAT12_INDEX *index, const char *filename);
     
 uint32_t get_file_size(struct BPB *bpb, const char *buffer, const char *filename_to_find);
 void list_files(struct BPB *bpb, const char *buffer);
@@ -53,12 +212,90 @@ int load_file_to_buffer(struct BPB *bpb, const char *buffer, const char *filenam
 
 // int load_file_to_buffer(struct BPB *bpb, const char *buffer, const char *filename_to_find, char *fileBuffer, uint32_t buffer_size);
 
+
+// Open file: the read position and the cluster that holds it, so sequential
+// reads go on where the last one stopped. A seek is found in the runs of the
+// file, or for a file without runs from a skip index of the chain (the
+// cluster of every skip_stride-th file cluster, filled as the chain is walked).
+#define FAT12_SKIP_ENTRIES 32
+
+struct FAT12_FILE {
+    const struct BPB *bpb;
+    const char *buffer;
+    const struct FILE_ENTRY *entry;
+    struct FAT12_MANIFEST *manifest;    // NULL for none
+    struct FAT12_CHECK check;           // What this file has checked against it
+    uint32_t cluster_size;
+    uint32_t position;                  // Next byte of the file to read
+    uint32_t index;                     // File cluster that holds it,
+    uint16_t cluster;                   // its cluster number
+    uint32_t run;                       // and the clusters from it that follow each other
+    uint32_t skip_stride;
+    uint8_t skip_known;
+    uint16_t skip[FAT12_SKIP_ENTRIES];
+};
+
+// Open the file at position 0. With a manifest (NULL for none) every cluster
+// is checked as it is read. Return 0, or -1.
+int fat12_open(struct FAT12_FILE *file, const struct BPB *bpb, const char *buffer,
+               const struct FILE_ENTRY *entry, struct FAT12_MANIFEST *manifest);
+
+// Move to offset (up to the file size). Return 0, or -1.
+int fat12_seek(struct FAT12_FILE *file, uint32_t offset);
+
+// Read up to len bytes from the position. Return the bytes read (0 at the
+// end of the file), -1 on error, FAT12_CRC_ERROR if a cluster does not match.
+int fat12_read(struct FAT12_FILE *file, char *data, uint32_t len);
+
+// Piece of a file in the mounted image
+struct FAT12_SPAN {
+    const char *data;
+    uint32_t length;
+};
+
+// Where the next len bytes from the position are, without copying them: one
+// span per run of clusters (per cluster with a manifest, each checked before
+// it is given), the last one cut at the file size. At most max_spans, the
+// position moves past them and bytes (NULL for none) gets their total. A byte
+// range is a fat12_seek, then fat12_spans. Return the number of spans (0 at
+// the end of the file), -1 on error, FAT12_CRC_ERROR if a cluster does not match.
+int fat12_spans(struct FAT12_FILE *file, uint32_t len, struct FAT12_SPAN *spans, int max_spans, uint32_t *bytes);
+
 // In the microcontroller we will use a small 512 byte byffer to load chunks of file
 // and send by HTML CHUNKED TRANSFER, that's why we don't need the above load_file_to_buffer function
 // We don't load the entire file at once. Why waste memory??!!!
+// The first version of the reads by chunks, new code uses a FAT12_FILE.
+// With a manifest (NULL for none) every cluster is checked, FAT12_CRC_ERROR
+// is returned as soon as one does not match.
 int load_file_chunk(struct BPB *bpb, const char *buffer, const struct FILE_ENTRY *file_entry,
                     char *fileBuffer, uint32_t buffer_size, 
                     uint32_t offset, uint32_t chunk_size, 
-                    uint16_t *last_cluster, uint32_t *bytes_read_so_far);
+                    uint16_t *last_cluster, uint32_t *bytes_read_so_far,
+                    struct FAT12_MANIFEST *manifest);
+
+
+// Image file of a FAT12 volume (FAT12_IMAGE.c), the buffer of the functions
+// above. Mapped read-only (MapViewOfFile, mmap), the pages of the FAT, of the
+// directory and of the clusters read are loaded when they are touched; or
+// read into memory at once as before. Only the volume the boot sector
+// describes is in the buffer, a dump of a card bigger than 2 GB (or than the
+// address space of the -m32 build) with the FAT12 volume at its start is
+// mounted all the same.
+#define FAT12_IMAGE_MAP  0
+#define FAT12_IMAGE_READ 1
+
+struct FAT12_IMAGE {
+    char *buffer;
+    uint32_t size;          // Bytes in buffer: the volume, or the file if it is shorter
+    uint64_t file_size;     // Size of the image file
+    int mode;               // FAT12_IMAGE_MAP or FAT12_IMAGE_READ
+};
+
+// Return 0, or -1 (the error is printed).
+int fat12_image_open(struct FAT12_IMAGE *image, const char *path, int mode);
+void fat12_image_close(struct FAT12_IMAGE *image);
+
+// Resident memory of the process in bytes, 0 if it is not known here
+uint64_t fat12_image_rss(void);
 
 #endif // FAT12_H
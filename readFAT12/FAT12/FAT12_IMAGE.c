@@ -0,0 +1,163 @@
+// 64-bit file sizes in the 32-bit builds
+#ifndef _WIN32
+#define _FILE_OFFSET_BITS 64
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#define PSAPI_VERSION 2     // GetProcessMemoryInfo from kernel32, no -lpsapi
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "FAT12.h"
+
+#define FAT12_BOOT_SIZE 36  // Boot sector up to the 32-bit sector count
+
+
+static int fat12_file_size(const char *path, uint64_t *size) {
+#ifdef _WIN32
+    struct __stat64 st;
+    if (_stat64(path, &st) != 0) return -1;
+#else
+    struct stat st;
+    if (stat(path, &st) != 0) return -1;
+#endif
+    *size = (uint64_t)st.st_size;
+    return 0;
+}
+
+
+// Bytes of the volume the boot sector describes, 0 if it is not one
+static uint64_t fat12_volume_size(const uint8_t *boot) {
+    uint32_t sector_size = boot[11] | (boot[12] << 8);
+    uint32_t sectors = boot[19] | (boot[20] << 8);
+
+    // Volumes of 65536 sectors and more have their count at 32
+    if (sectors == 0) sectors = boot[32] | (boot[33] << 8) | (boot[34] << 16) | ((uint32_t)boot[35] << 24);
+    return (uint64_t)sector_size * sectors;
+}
+
+
+int fat12_image_open(struct FAT12_IMAGE *image, const char *path, int mode) {
+    uint8_t boot[FAT12_BOOT_SIZE] = { 0 };
+
+    memset(image, 0, sizeof(*image));
+    image->mode = mode;
+    if (fat12_file_size(path, &image->file_size) != 0) {
+        perror(path);
+        return -1;
+    }
+
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        perror(path);
+        return -1;
+    }
+    size_t boot_size = fread(boot, 1, sizeof(boot), file);
+
+    // The volume, the rest of a bigger dump is never read
+    uint64_t size = image->file_size;
+    uint64_t volume = (boot_size == sizeof(boot)) ? fat12_volume_size(boot) : 0;
+    if (volume > 0 && volume < size) size = volume;
+    if (size == 0 || size > UINT32_MAX || size > SIZE_MAX) {
+        printf("Error: %s is %s\n", path, size ? "too big and has no FAT12 volume at its start" : "empty");
+        fclose(file);
+        return -1;
+    }
+    image->size = (uint32_t)size;
+
+    if (mode == FAT12_IMAGE_READ) {
+        image->buffer = (char *)malloc(image->size);
+        if (image->buffer == NULL) {
+            perror("Memory allocation for the image failed");
+            fclose(file);
+            return -1;
+        }
+        if (fseek(file, 0, SEEK_SET) != 0 || fread(image->buffer, 1, image->size, file) != image->size) {
+            perror(path);
+            free(image->buffer);
+            image->buffer = NULL;
+            fclose(file);
+            return -1;
+        }
+        fclose(file);
+        return 0;
+    }
+    fclose(file);
+
+    // The view keeps the file open, the handles are not needed any more
+#ifdef _WIN32
+    HANDLE handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    HANDLE mapping = NULL;
+    if (handle != INVALID_HANDLE_VALUE) {
+        mapping = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+        CloseHandle(handle);
+    }
+    if (mapping != NULL) {
+        image->buffer = (char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, image->size);
+        CloseHandle(mapping);
+    }
+    if (image->buffer == NULL) {
+        printf("Error: cannot map %s (error %lu)\n", path, (unsigned long)GetLastError());
+        return -1;
+    }
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+    void *view = mmap(NULL, image->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (view == MAP_FAILED) {
+        perror(path);
+        return -1;
+    }
+    image->buffer = (char *)view;
+#endif
+    return 0;
+}
+
+
+void fat12_image_close(struct FAT12_IMAGE *image) {
+    if (image->buffer == NULL) return;
+
+    if (image->mode == FAT12_IMAGE_READ) {
+        free(image->buffer);
+    } else {
+#ifdef _WIN32
+        UnmapViewOfFile(image->buffer);
+#else
+        munmap(image->buffer, image->size);
+#endif
+    }
+    image->buffer = NULL;
+}
+
+
+uint64_t fat12_image_rss(void) {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+    return counters.WorkingSetSize;
+#elif defined(__linux__)
+    unsigned long pages = 0, resident = 0;
+    FILE *statm = fopen("/proc/self/statm", "r");
+    if (statm == NULL) return 0;
+    if (fscanf(statm, "%lu %lu", &pages, &resident) != 2) resident = 0;
+    fclose(statm);
+    return (uint64_t)resident * (uint64_t)sysconf(_SC_PAGESIZE);
+#else
+    return 0;
+#endif
+}
@@ -0,0 +1,134 @@
+#include <stdint.h>
+#include <string.h>
+#include "FAT12.h"
+
+// Root directory scan for one raw 8.3 name. The first 16 bytes of an entry
+// are the name (11 bytes), the attributes and 4 bytes that do not matter:
+// masked with 11 x 0xFF, 0x08 and zeros they equal the name followed by 16 - 11
+// zeros only if the name matches and the entry is not a volume label (or a
+// long name part). An entry that starts with 0xE5 (deleted) cannot match
+// since no query starts with it. One compare and one mask per entry.
+// The SSE2 kernel is built with a target attribute, the rest of the program
+// keeps the plain -m32 code generation. GCC makes the 11 byte memcmp of the
+// scalar kernel two word compares that stop at the first one, and on the PCs
+// we measured (FAT12Bench --scan) it is faster than the vector kernels, so
+// they are only used when built with -DFAT12_SCAN_SIMD (SSE2 after CPUID).
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FAT12_HAVE_SSE2 1
+#include <cpuid.h>
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define FAT12_HAVE_NEON 1
+#include <arm_neon.h>
+#endif
+
+static const uint8_t fat12_scan_mask[16] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x08, 0, 0, 0, 0
+};
+
+
+int fat12_scan_name_scalar(const char *dir, uint16_t entries, const char *raw) {
+    if ((uint8_t)raw[0] == 0xE5 || raw[0] == 0x00) return -1;
+
+    for (uint16_t i = 0; i < entries; i++) {
+        const char *entry = dir + i * FAT12_ENTRY_SIZE;
+
+        // First byte 0x00 indicates no more entries
+        if (entry[0] == 0x00) break;
+        if (memcmp(entry, raw, FAT12_FILENAME_LENGTH) == 0 && !(entry[11] & 0x08)) return i;
+    }
+    return -1;
+}
+
+
+#ifdef FAT12_HAVE_SSE2
+
+__attribute__((target("sse2")))
+int fat12_scan_name_sse2(const char *dir, uint16_t entries, const char *raw) {
+    uint8_t key[16] = { 0 };
+
+    if ((uint8_t)raw[0] == 0xE5 || raw[0] == 0x00) return -1;
+    memcpy(key, raw, FAT12_FILENAME_LENGTH);
+
+    const __m128i want = _mm_loadu_si128((const __m128i *)key);
+    const __m128i mask = _mm_loadu_si128((const __m128i *)fat12_scan_mask);
+
+    // 4 entries per step in one mask, 4 bits per entry: the 4 dword compares
+    // of an entry packed together, and the end (first byte 0) of the 4 first
+    // dwords. The step with the end or a match is done again one by one.
+    const __m128i zero = _mm_setzero_si128();
+    uint16_t i = 0;
+    for (; i + 4 <= entries; i += 4) {
+        const char *entry = dir + i * FAT12_ENTRY_SIZE;
+        __m128i x0 = _mm_loadu_si128((const __m128i *)entry);
+        __m128i x1 = _mm_loadu_si128((const __m128i *)(entry + 32));
+        __m128i x2 = _mm_loadu_si128((const __m128i *)(entry + 64));
+        __m128i x3 = _mm_loadu_si128((const __m128i *)(entry + 96));
+        __m128i e01 = _mm_packs_epi32(_mm_cmpeq_epi32(_mm_and_si128(x0, mask), want),
+                                      _mm_cmpeq_epi32(_mm_and_si128(x1, mask), want));
+        __m128i e23 = _mm_packs_epi32(_mm_cmpeq_epi32(_mm_and_si128(x2, mask), want),
+                                      _mm_cmpeq_epi32(_mm_and_si128(x3, mask), want));
+        __m128i first = _mm_unpacklo_epi64(_mm_unpacklo_epi32(x0, x1), _mm_unpacklo_epi32(x2, x3));
+
+        int equal = _mm_movemask_epi8(_mm_packs_epi16(e01, e23));
+        int end = _mm_movemask_epi8(_mm_cmpeq_epi8(first, zero));
+        if (((equal & (equal >> 1) & (equal >> 2) & (equal >> 3)) | end) & 0x1111) break;
+    }
+
+    for (; i < entries; i++) {
+        const char *entry = dir + i * FAT12_ENTRY_SIZE;
+        __m128i name = _mm_and_si128(_mm_loadu_si128((const __m128i *)entry), mask);
+
+        if (entry[0] == 0x00) break;
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(name, want)) == 0xFFFF) return i;
+    }
+    return -1;
+}
+
+
+#ifdef FAT12_SCAN_SIMD
+static int fat12_has_sse2(void) {
+    static int sse2 = -1;
+    unsigned int eax, ebx, ecx, edx;
+
+    if (sse2 < 0) sse2 = __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (edx & bit_SSE2);
+    return sse2;
+}
+#endif
+
+#endif // FAT12_HAVE_SSE2
+
+
+#ifdef FAT12_HAVE_NEON
+
+int fat12_scan_name_neon(const char *dir, uint16_t entries, const char *raw) {
+    uint8_t key[16] = { 0 };
+
+    if ((uint8_t)raw[0] == 0xE5 || raw[0] == 0x00) return -1;
+    memcpy(key, raw, FAT12_FILENAME_LENGTH);
+
+    const uint8x16_t want = vld1q_u8(key);
+    const uint8x16_t mask = vld1q_u8(fat12_scan_mask);
+
+    for (uint16_t i = 0; i < entries; i++) {
+        const char *entry = dir + i * FAT12_ENTRY_SIZE;
+        uint8x16_t name = vandq_u8(vld1q_u8((const uint8_t *)entry), mask);
+
+        if (entry[0] == 0x00) break;
+        if (vminvq_u8(vceqq_u8(name, want)) == 0xFF) return i;
+    }
+    return -1;
+}
+
+#endif // FAT12_HAVE_NEON
+
+
+int fat12_scan_name(const char *dir, uint16_t entries, const char *raw) {
+#if defined(FAT12_SCAN_SIMD) && defined(FAT12_HAVE_SSE2)
+    if (fat12_has_sse2()) return fat12_scan_name_sse2(dir, entries, raw);
+#elif defined(FAT12_SCAN_SIMD) && defined(FAT12_HAVE_NEON)
+    return fat12_scan_name_neon(dir, entries, raw);
+#endif
+    return fat12_scan_name_scalar(dir, entries, raw);
+}
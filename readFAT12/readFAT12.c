@@ -14,7 +14,14 @@
 #include <stdint.h>
 #include <ctype.h>
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
 #include "FAT12.h"
+#include "CRC32.h"
 
 // Define constants for display formatting
 #define NAME_WIDTH 15
@@ -23,74 +30,147 @@
 
 struct BPB bpb;
 
-// Global file pointer to simulate SD card access
-FILE *sdcard_file;
+// Image file simulating SD card access, mapped or read
+struct FAT12_IMAGE sdcard;
 
 // Global buffer simulating SD card
 char *FAT12_buffer;
 
-// Size of the buffer representing the SD card
-int32_t sdcard_size;
-
 
 // There are needed by the FAT12 library
 uint8_t NO_OF_FILES = 0;
 struct FILE_ENTRY FILES[20];  // Array to store up to 20 files
-uint16_t last_cluster = 0;
-uint32_t bytes_read_so_far = 0;
 
 // Buffer to store the file chunk (we will send HTML chunks only)
 char fileChunkBuffer[4096];
 
 char fileBuffer[FILEBUFFER_SIZE]; // 264kB +100 bytes
 
+// FAT decoded once, the cluster chains are walked from it
+struct FAT12_FAT decodedFat;
+
+// Names of FILES, load_file_to_buffer finds a file without scanning the directory
+struct FAT12_INDEX nameIndex;
+
+// Per cluster CRC manifest of the streamed file (4 bytes per 4 KB cluster)
+char manifestBuffer[4096];
+
+
+// Wall clock in seconds
+static double now(void) {
+#ifdef _WIN32
+    LARGE_INTEGER freq, count;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    return (double)count.QuadPart / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
 
-int loadDataspaceBuff(char *fname)
+int loadDataspaceBuff(char *fname, int mode)
 {
-    // Open the file in binary mode (read binary)
-    sdcard_file = fopen(fname, "rb");
-    if (sdcard_file == NULL) {
-        perror("Error opening UDISK file");
+    // Mapped, its pages are loaded as they are touched, or all read at once
+    if (fat12_image_open(&sdcard, fname, mode) != 0) {
+        printf("Error loading UDISK file\n");
         return 1;
     }
+    FAT12_buffer = sdcard.buffer;
 
-    // Find the size of the file
-    if (fseek(sdcard_file, 0, SEEK_END) != 0) {  // Move the file pointer to the end of the file
-        perror("Error seeking to the end of the UDISK file");
-        fclose(sdcard_file);
-        return 1;
+    // Print FAT12 buffer size
+    printf("FAT12 file %s successfully, size: %llu bytes, volume %u bytes\n",
+           mode == FAT12_IMAGE_MAP ? "mapped" : "loaded", (unsigned long long)sdcard.file_size, sdcard.size);
+
+    return 0;  // Success
+}
+
+
+// Check the CRC32 trailer that CRC32ToFile appends to a file.
+// The trailer can be CRC-32 (the default) or any model of --poly, so each
+// model is tried in the order of CRC32_MODELS.h. A binary trailer
+// (--trailer=binary) is found in one pass: the CRC of the whole file is the
+// residue of the model. Otherwise the last 8 bytes are hex digits.
+int check_crc_trailer(const char *data, int size)
+{
+    char trailer[9] = {0};
+
+    for (int m = 0; crc32_models[m] != NULL; m++) {
+        if (crc32_model_compute(crc32_models[m], data, size) == crc32_model_residue(crc32_models[m])) {
+            printf("CRC32 (%s) binary trailer OK\n", crc32_models[m]->name);
+            return 0;
+        }
     }
 
-    sdcard_size = ftell(sdcard_file);  // Get the current file pointer (this is the size of the file)
-    if (sdcard_size == -1) {
-        perror("Error getting the UDISK file size");
-        fclose(sdcard_file);
-        return 1;
+    if (size < 8) {
+        printf("File too small for a CRC32 trailer\n");
+        return -1;
+    }
+
+    memcpy(trailer, data + size - 8, 8);
+    for (int i = 0; i < 8; i++) {
+        if (!isxdigit((unsigned char)trailer[i])) {
+            printf("No CRC32 trailer at the end of the file\n");
+            return -1;
+        }
     }
 
-    rewind(sdcard_file);  // Move the file pointer back to the beginning
+    uint32_t expected = (uint32_t)strtoul(trailer, NULL, 16);
 
-    // Allocate memory for the buffer based on file size
-    FAT12_buffer = (char *)malloc(sdcard_size);
-    if (FAT12_buffer == NULL) {
-        perror("Memory allocation for UDISK file failed");
-        fclose(sdcard_file);
-        return 1;
+    for (int m = 0; crc32_models[m] != NULL; m++) {
+        if (crc32_model_compute(crc32_models[m], data, size - 8) == expected) {
+            printf("CRC32 (%s) trailer OK: 0x%08X\n", crc32_models[m]->name, expected);
+            return 0;
+        }
     }
 
-    // Read the entire file into the buffer
-    size_t read_size = fread(FAT12_buffer, 1, sdcard_size, sdcard_file);
-    if (read_size != sdcard_size) {
-        perror("Error loading UDISK file");
-        free(FAT12_buffer);
-        fclose(sdcard_file);
-        return 1;
+    printf("CRC32 MISMATCH: trailer 0x%08X, data 0x%08X (ieee)\n", expected,
+           crc32_model_compute(&crc32_model_ieee, data, size - 8));
+    return 1;
+}
+
+
+// Stream a file by chunks as the web server does, checking every cluster
+// against its manifest (<name>.CRM, made by CRC32ToFile --manifest) if the
+// image has one. The chunks are spans of the image, not copies, and their
+// CRC-32 is computed on the way. Return 0, -1 if there is no manifest,
+// FAT12_CRC_ERROR.
+int stream_file_checked(const char *filename)
+{
+    struct FAT12_MANIFEST manifest;
+    struct FAT12_FILE file;
+    struct FAT12_SPAN spans[2];     // A chunk crosses at most one cluster end
+    char manifest_name[13];
+    const struct FILE_ENTRY *file_entry = NULL;
+
+    snprintf(manifest_name, sizeof(manifest_name), "%s", filename);
+    char *dot = strrchr(manifest_name, '.');
+    if (dot == NULL || strlen(dot) != 4) return -1;
+    strcpy(dot, ".CRM");
+
+    for (int i = 0; i < NO_OF_FILES; i++) {
+        if (strcmp(FILES[i].name, filename) == 0) file_entry = &FILES[i];
+    }
+    int manifest_size = load_file_to_buffer(&bpb, FAT12_buffer, manifest_name, manifestBuffer, sizeof(manifestBuffer));
+    if (file_entry == NULL || manifest_size <= 0 ||
+        fat12_manifest_load(&manifest, manifestBuffer, (uint32_t)manifest_size) != 0) {
+        return -1;
     }
 
-    // Print FAT12 buffer size
-    printf("FAT12 file loaded successfully, size: %ld bytes\n", sdcard_size);
+    if (fat12_open(&file, &bpb, FAT12_buffer, file_entry, &manifest) != 0) return -1;
+    uint32_t crc = CRC32_INIT;
+    while (1) {
+        int count = fat12_spans(&file, CHUNK_SIZE, spans, 2, NULL);
+        if (count == FAT12_CRC_ERROR) return FAT12_CRC_ERROR;
+        if (count <= 0) break;
+        for (int i = 0; i < count; i++) crc = crc32_update(crc, spans[i].data, spans[i].length);
+    }
 
-    return 0;  // Success
+    printf("%s: %u clusters checked against %s, CRC-32 0x%08X\n", filename, manifest.count, manifest_name,
+           crc32_final(crc));
+    return 0;
 }
 
 
@@ -99,14 +179,22 @@ int main(int argc, char *argv[])
     // Clear the screen
     system("cls");
     
+    // --read loads the whole image as before instead of mapping it
+    int mode = FAT12_IMAGE_MAP;
+    int arg = 1;
+    if (argc > 1 && strcmp(argv[1], "--read") == 0) {
+        mode = FAT12_IMAGE_READ;
+        arg++;
+    }
+
     // Check if file name is provided
-    if (argc < 2) {
-        printf("Usage: %s <filename>\n", argv[0]);
+    if (argc <= arg) {
+        printf("Usage: %s [--read] <filename>\n", argv[0]);
         return 1;
     }
 
     // Open the file provided as the first argument
-    char *fn = argv[1];
+    char *fn = argv[arg];
     
     // Use these if you want to run from the IDE not from command line
     //char *fn = "25Q32FLASH_last"; //argv[1];
@@ -119,7 +207,8 @@ int main(int argc, char *argv[])
     
     // Load all data from the file to a buffer we will use 
     // as a FAT12 simultated dataspace
-    if (loadDataspaceBuff(fn) != 0) {
+    double start = now();
+    if (loadDataspaceBuff(fn, mode) != 0) {
         return 1;     
     }
 
@@ -134,11 +223,20 @@ int main(int argc, char *argv[])
 	
     // Load BPB from the boot sector (first sector of the buffer)
     load_bpb(&bpb, FAT12_buffer);
+    fat12_decode_fat(&decodedFat, &bpb, FAT12_buffer);
+    fat12_fat = &decodedFat;
 
     printf("\n");
  
      // Call the function to list the files
     NO_OF_FILES = get_files(&bpb, FAT12_buffer, FILES);
+    if (fat12_index_build(&nameIndex, &bpb, FAT12_buffer, FILES, NO_OF_FILES) == 0) {
+        fat12_index = &nameIndex;
+    }
+
+    // Startup time and resident memory, to compare the two modes
+    printf("Mounted in %.3f ms, RSS %llu KB\n", (now() - start) * 1e3,
+           (unsigned long long)(fat12_image_rss() / 1024));
 
     // Print the table header
     printf("%-8s %-*s %-*s %-*s\n", "Index", NAME_WIDTH, "Name", SIZE_WIDTH, "Size", LOCATION_WIDTH, "Location");
@@ -175,23 +273,35 @@ int main(int argc, char *argv[])
     
     printf("%s\n", fileBuffer);
     printf("\nFile size %u bytes.\n", bytes_loaded);
+
+    // Files stamped with CRC32ToFile end with their CRC32 in hex
+    if (bytes_loaded > 0) {
+        char tune_file[1024];
+        crc32_tune_path(tune_file, sizeof(tune_file), argv[0]);
+        crc32_autotune(tune_file, 0);
+
+        check_crc_trailer(fileBuffer, bytes_loaded);
+    }
+
+    // Stream it again by chunks, each cluster checked against the manifest
+    stream_file_checked("WSCLI.HTM");
+    printf("RSS after reading WSCLI.HTM %llu KB\n", (unsigned long long)(fat12_image_rss() / 1024));
                     
      
 /*
     // Read a file by chunks of 512 byte each, until EOF is reached
+    struct FAT12_FILE file;
+    fat12_open(&file, &bpb, FAT12_buffer, &FILES[4], NULL);
     while (1) {
         // Read the next chunk from the file
-        int bytes_read = load_file_chunk(&bpb, FAT12_buffer, &FILES[4], 
-                                         fileChunkBuffer, sizeof(fileChunkBuffer), 
-                                         bytes_read_so_far, CHUNK_SIZE, 
-                                         &last_cluster, &bytes_read_so_far);
+        int bytes_read = fat12_read(&file, fileChunkBuffer, CHUNK_SIZE);
         // If no more bytes are read, break the loop
         if (bytes_read <= 0) {
             break;
         }
 
         // Print the chunk data (as hex or plain text)
-        printf("Chunk at offset %u, bytes read: %d\n", bytes_read_so_far - bytes_read, bytes_read);
+        printf("Chunk at offset %u, bytes read: %d\n", file.position - bytes_read, bytes_read);
         for (int i = 0; i < bytes_read; i++) {
             printf("%02X ", (unsigned char)fileChunkBuffer[i]);
             if ((i + 1) % 16 == 0) {
@@ -207,11 +317,8 @@ int main(int argc, char *argv[])
     }
 */      
     
-    // Free the buffer when you're done
-    free(FAT12_buffer);
-
-    // Close the file
-    fclose(sdcard_file);
+    // Unmap or free the buffer when you're done
+    fat12_image_close(&sdcard);
 
     printf("\nPress any key...\n");
     getchar();  // Waits for a keypress